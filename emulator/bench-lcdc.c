@@ -0,0 +1,100 @@
+/**
+ * @file bench-lcdc.c
+ * @brief Benchmark of the LCD controller rendering sprite-heavy frames
+ *
+ * @date 2020
+ */
+
+#include "lcdc.h"
+#include "gameboy.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFAULT_FRAMES 1000
+
+// ======================================================================
+static double now_ms(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+// ======================================================================
+/**
+ * @brief Renders the given number of frames
+ * @param gb Game Boy, the screen of which is run
+ * @param frames number of frames
+ * @param dma whether OAM is rewritten before each frame (as by a DMA in VBlank)
+ * @return milliseconds per frame, negative on error
+ */
+static double run(gameboy_t* gb, int frames, int dma)
+{
+    lcdc_t* const lcd = &(gb->screen);
+    const double start = now_ms();
+
+    for (int f = 0; f < frames; ++f) {
+        if (dma) {
+            // same contents: only the cost of a change of OAM is measured
+            for (addr_t a = GRAPH_RAM_START; a <= GRAPH_RAM_END; ++a) {
+                *(gb->bus[a]) = *(gb->bus[a]);
+                if (lcdc_bus_listener(lcd, a) != ERR_NONE) return -1;
+            }
+        }
+        if (lcdc_catch_up(lcd, lcd->cycles + FRAME_TOTAL_CYCLES) != ERR_NONE) return -1;
+    }
+
+    return (now_ms() - start) / frames;
+}
+
+// ======================================================================
+int main(int argc, char* argv[])
+{
+    const int frames = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAMES;
+    const int threads = argc > 2 ? atoi(argv[2]) : 1;
+    if (frames <= 0 || threads <= 0) {
+        fprintf(stderr, "usage: %s [frames [rendering threads]]\n", argv[0]);
+        return 1;
+    }
+
+    // the LCDC alone, on a bus backed by a plain 64k memory
+    gameboy_t* gb = calloc(1, sizeof(gameboy_t));
+    data_t* mem = calloc(1, 0x10000);
+    if (gb == NULL || mem == NULL) return 1;
+    for (size_t a = 0; a < 0x10000; ++a) {
+        gb->bus[a] = &mem[a];
+    }
+    gb->cpu.bus = &(gb->bus);
+
+    // random tiles and maps, 40 8x16 sprites spread over the screen, everything enabled
+    srand(1);
+    for (size_t a = VIDEO_RAM_START; a <= VIDEO_RAM_END; ++a) {
+        mem[a] = (data_t) rand();
+    }
+    for (size_t i = 0; i < 40; ++i) {
+        mem[GRAPH_RAM_START + 4 * i + 0] = (data_t) (16 + (i * 37) % LCD_HEIGHT);
+        mem[GRAPH_RAM_START + 4 * i + 1] = (data_t) (8 + (i * 53) % LCD_WIDTH);
+        mem[GRAPH_RAM_START + 4 * i + 2] = (data_t) rand();
+        mem[GRAPH_RAM_START + 4 * i + 3] = (data_t) (rand() & 0xF0);
+    }
+    mem[REG_BGP] = 0xE4;
+    mem[REG_OBP0] = 0xD2;
+    mem[REG_OBP1] = 0x1B;
+    mem[REG_WX] = 80;
+    mem[REG_WY] = 72;
+    mem[REG_LCDC] = 0xFF;
+
+    if (lcdc_init(gb) != ERR_NONE || lcdc_set_render_threads(&(gb->screen), (size_t) threads) != ERR_NONE) return 1;
+
+    printf("%d sprite-heavy frames, %d rendering thread(s)\n", frames, threads);
+    printf("static OAM:            %.4f ms/frame\n", run(gb, frames, 0));
+    printf("OAM written per frame: %.4f ms/frame\n", run(gb, frames, 1));
+
+    lcdc_free(&(gb->screen));
+    free(mem);
+    free(gb);
+    return 0;
+}
@@ -12,54 +12,245 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h> // memcpy, memset
 #include "myMacros.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// ======================================================================
+/*
+ * Word kernels: bulk operations over the content of bit vectors, in a
+ * portable 64-bit version and (on x86) SSE2 and AVX2 ones, the best one
+ * supported by the CPU being selected once at startup.
+ */
+typedef struct {
+    bit_vector_isa_t isa;
+    void (*not)   (uint32_t* dst, size_t n);
+    void (*and)   (uint32_t* dst, const uint32_t* src, size_t n);
+    void (*or)    (uint32_t* dst, const uint32_t* src, size_t n);
+    void (*xor)   (uint32_t* dst, const uint32_t* src, size_t n);
+    void (*andnot)(uint32_t* dst, const uint32_t* src, size_t n);
+    void (*or_and)(uint32_t* dst, const uint32_t* src1, const uint32_t* src2, size_t n);
+    void (*blend) (uint32_t* dst, const uint32_t* src1, const uint32_t* src2, const uint32_t* mask, size_t n);
+} bit_vector_kernels_t;
+
+/*
+ * Defines the kernels of an instruction set, working on W words at a time
+ * (and on single words for what remains)
+ */
+#define DEFINE_KERNELS(ISA, TARGET, VEC, W, LOAD, STORE, AND, OR, XOR, ANDNOT, ONES) \
+    TARGET static void ISA ## _not(uint32_t* dst, size_t n) { \
+        size_t i = 0; \
+        for (; i + W <= n; i += W) STORE(dst + i, XOR(LOAD(dst + i), ONES)); \
+        for (; i < n; ++i) dst[i] = ~dst[i]; \
+    } \
+    TARGET static void ISA ## _and(uint32_t* dst, const uint32_t* src, size_t n) { \
+        size_t i = 0; \
+        for (; i + W <= n; i += W) STORE(dst + i, AND(LOAD(dst + i), LOAD(src + i))); \
+        for (; i < n; ++i) dst[i] &= src[i]; \
+    } \
+    TARGET static void ISA ## _or(uint32_t* dst, const uint32_t* src, size_t n) { \
+        size_t i = 0; \
+        for (; i + W <= n; i += W) STORE(dst + i, OR(LOAD(dst + i), LOAD(src + i))); \
+        for (; i < n; ++i) dst[i] |= src[i]; \
+    } \
+    TARGET static void ISA ## _xor(uint32_t* dst, const uint32_t* src, size_t n) { \
+        size_t i = 0; \
+        for (; i + W <= n; i += W) STORE(dst + i, XOR(LOAD(dst + i), LOAD(src + i))); \
+        for (; i < n; ++i) dst[i] ^= src[i]; \
+    } \
+    TARGET static void ISA ## _andnot(uint32_t* dst, const uint32_t* src, size_t n) { \
+        size_t i = 0; \
+        for (; i + W <= n; i += W) STORE(dst + i, ANDNOT(LOAD(dst + i), LOAD(src + i))); \
+        for (; i < n; ++i) dst[i] &= ~src[i]; \
+    } \
+    TARGET static void ISA ## _or_and(uint32_t* dst, const uint32_t* src1, const uint32_t* src2, size_t n) { \
+        size_t i = 0; \
+        for (; i + W <= n; i += W) STORE(dst + i, OR(LOAD(dst + i), AND(LOAD(src1 + i), LOAD(src2 + i)))); \
+        for (; i < n; ++i) dst[i] |= src1[i] & src2[i]; \
+    } \
+    TARGET static void ISA ## _blend(uint32_t* dst, const uint32_t* src1, const uint32_t* src2, const uint32_t* mask, size_t n) { \
+        size_t i = 0; \
+        for (; i + W <= n; i += W) { \
+            const VEC m = LOAD(mask + i); \
+            STORE(dst + i, OR(ANDNOT(LOAD(src1 + i), m), AND(LOAD(src2 + i), m))); \
+        } \
+        for (; i < n; ++i) dst[i] = (src1[i] & ~mask[i]) | (src2[i] & mask[i]); \
+    } \
+    static const bit_vector_kernels_t ISA ## _kernels = { \
+        BIT_VECTOR_ISA_ ## ISA, ISA ## _not, ISA ## _and, ISA ## _or, ISA ## _xor, ISA ## _andnot, ISA ## _or_and, ISA ## _blend \
+    }
+
+// portable version, 64 bits at a time (memcpy to allow any alignment)
+static inline uint64_t load64(const uint32_t* p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+static inline void store64(uint32_t* p, uint64_t v) { memcpy(p, &v, sizeof(v)); }
+#define OP_AND(a, b)    ((a) & (b))
+#define OP_OR(a, b)     ((a) | (b))
+#define OP_XOR(a, b)    ((a) ^ (b))
+#define OP_ANDNOT(a, b) ((a) & ~(b))
+
+DEFINE_KERNELS(SCALAR, , uint64_t, 2, load64, store64, OP_AND, OP_OR, OP_XOR, OP_ANDNOT, UINT64_MAX);
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BIT_VECTOR_X86
+
+// _mm*_andnot_si*(a, b) computes ~a & b
+#define SSE2_LOAD(p)       _mm_loadu_si128((const __m128i*) (p))
+#define SSE2_STORE(p, v)   _mm_storeu_si128((__m128i*) (p), v)
+#define SSE2_ANDNOT(a, b)  _mm_andnot_si128(b, a)
+DEFINE_KERNELS(SSE2, __attribute__((target("sse2"))), __m128i, 4, SSE2_LOAD, SSE2_STORE,
+               _mm_and_si128, _mm_or_si128, _mm_xor_si128, SSE2_ANDNOT, _mm_set1_epi32(-1));
+
+#define AVX2_LOAD(p)       _mm256_loadu_si256((const __m256i*) (p))
+#define AVX2_STORE(p, v)   _mm256_storeu_si256((__m256i*) (p), v)
+#define AVX2_ANDNOT(a, b)  _mm256_andnot_si256(b, a)
+DEFINE_KERNELS(AVX2, __attribute__((target("avx2"))), __m256i, 8, AVX2_LOAD, AVX2_STORE,
+               _mm256_and_si256, _mm256_or_si256, _mm256_xor_si256, AVX2_ANDNOT, _mm256_set1_epi32(-1));
+#endif
+
+static const bit_vector_kernels_t* kernels = &SCALAR_kernels;
+
+/**
+ * @brief Selects the best kernels the CPU supports (CPUID), before main()
+ */
+__attribute__((constructor)) static void bit_vector_select_isa(void)
+{
+#ifdef BIT_VECTOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels = &AVX2_kernels;
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernels = &SSE2_kernels;
+    }
+#endif
+}
+
+// ==== see bit_vector.h ========================================
+bit_vector_isa_t bit_vector_isa(void){
+    return kernels->isa;
+}
+
+// ==== see bit_vector.h ========================================
+int bit_vector_set_isa(bit_vector_isa_t isa){
+    switch(isa){
+    case BIT_VECTOR_ISA_SCALAR:
+        kernels = &SCALAR_kernels;
+        return ERR_NONE;
+#ifdef BIT_VECTOR_X86
+    case BIT_VECTOR_ISA_SSE2:
+        M_REQUIRE(__builtin_cpu_supports("sse2"), ERR_BAD_PARAMETER, "%s", "SSE2 is not supported");
+        kernels = &SSE2_kernels;
+        return ERR_NONE;
+    case BIT_VECTOR_ISA_AVX2:
+        M_REQUIRE(__builtin_cpu_supports("avx2"), ERR_BAD_PARAMETER, "%s", "AVX2 is not supported");
+        kernels = &AVX2_kernels;
+        return ERR_NONE;
+#endif
+    default:
+        M_EXIT(ERR_BAD_PARAMETER, "instruction set %d is not available", isa);
+    }
+}
+
+// ======================================================================
+#define valid_vector(pbv) ((pbv) != NULL && (pbv)->content != NULL)
+#define same_size(pbv1, pbv2) (valid_vector(pbv1) && valid_vector(pbv2) && (pbv1)->size == (pbv2)->size)
+
+/**
+ * @brief Sets up the (uninitialized) content of a bit vector of the given size:
+ *        inline if it fits, on the heap otherwise
+ * @param pbv bit vector to set up
+ * @param size size in bits (non zero)
+ * @return pbv, NULL on error
+ */
+static bit_vector_t* bit_vector_setup(bit_vector_t* pbv, size_t size)
+{
+    pbv->size = size;
+    pbv->nb_fields = size / 32 + (size % 32 != 0);
+    pbv->content = pbv->nb_fields <= BIT_VECTOR_INLINE_FIELDS ? pbv->inline_content
+                                                              : malloc(pbv->nb_fields * sizeof(uint32_t));
+    return pbv->content == NULL ? NULL : pbv;
+}
+
+/**
+ * @brief Allocates a bit vector of the given size, its content uninitialized
+ * @param size size in bits (non zero)
+ * @return pointer to the new bit vector, NULL on error
+ */
+static bit_vector_t* bit_vector_alloc(size_t size)
+{
+    bit_vector_t* res = malloc(sizeof(bit_vector_t));
+    if(res == NULL)
+        return NULL;
+
+    if(bit_vector_setup(res, size) == NULL){
+        free(res);
+        return NULL;
+    }
+
+    return res;
+}
+
+/**
+ * @brief Fills the content of a bit vector with the given bit value
+ * @param pbv bit vector to fill
+ * @param value bit value
+ * @return pbv
+ */
+static bit_vector_t* bit_vector_fill(bit_vector_t* pbv, bit_t value)
+{
+    memset(pbv->content, value ? 0xFF : 0, pbv->nb_fields * sizeof(uint32_t));
+    REMOVE_TAIL32(pbv);
+    return pbv;
+}
+
 // ==== see bit_vector.h ========================================
 bit_vector_t* bit_vector_create(size_t size, bit_t value){
     if(size == 0 || size >= (size_t) (-1))
         return NULL;
 
-    size_t rounded_size = size;
-    if(rounded_size % 32 != 0)
-        rounded_size += 32 - (rounded_size % 32);
+    bit_vector_t* res = bit_vector_alloc(size);
+    if(res == NULL)
+        return NULL;
 
-    bit_vector_t* res = malloc(sizeof(bit_vector_t));
-    
-    if(res == NULL) 
+    return bit_vector_fill(res, value);
+}
+
+// ==== see bit_vector.h ========================================
+bit_vector_t* bit_vector_init(bit_vector_t* pbv, size_t size, bit_t value){
+    if(pbv == NULL || size == 0 || size >= (size_t) (-1))
         return NULL;
 
-    res->content = calloc(rounded_size / 32 , sizeof(uint32_t));
-    if(res->content == NULL) 
+    if(bit_vector_setup(pbv, size) == NULL)
         return NULL;
 
-    res->size = size;
-    res->nb_fields = rounded_size / 32;
+    return bit_vector_fill(pbv, value);
+}
 
-    size_t fill = (value != 0) ? 0xFFFFFFFF : 0;
-    
-    res->content = memset(res->content, fill, sizeof(uint32_t) * res->nb_fields);
-    REMOVE_TAIL32(res);
-    return res;
+// ==== see bit_vector.h ========================================
+void bit_vector_release(bit_vector_t* pbv){
+    if(pbv == NULL)
+        return;
+
+    if(pbv->content != pbv->inline_content)
+        free(pbv->content);
+
+    pbv->content = NULL;
+    pbv->size = pbv->nb_fields = 0;
 }
 
 // ==== see bit_vector.h ========================================
 bit_vector_t* bit_vector_cpy(const bit_vector_t* pbv){
-    if(pbv == NULL || pbv->content == NULL) 
+    if(!valid_vector(pbv))
         return NULL;
-    
-    bit_vector_t* res = bit_vector_create(pbv->size, 0);
+
+    bit_vector_t* res = bit_vector_alloc(pbv->size);
     if(res == NULL)
         return NULL;
-    
-    for(int i = 0; i < pbv->nb_fields; ++i){
-        res->content[i] = pbv->content[i];
-    }
-
 
+    memcpy(res->content, pbv->content, pbv->nb_fields * sizeof(uint32_t));
     return res;
 }
 
@@ -70,12 +261,9 @@ bit_t bit_vector_get(const bit_vector_t* pbv, size_t index){
 
 // ==== see bit_vector.h ========================================
 bit_vector_t* bit_vector_not(bit_vector_t* pbv){
-    if(pbv == NULL || pbv->content == NULL) return NULL;
-
-    for(int i = 0; i < pbv->nb_fields; ++i){
-        pbv->content[i] = ~(pbv->content[i]);
-    }
+    if(!valid_vector(pbv)) return NULL;
 
+    kernels->not(pbv->content, pbv->nb_fields);
     REMOVE_TAIL32(pbv);
 
     return pbv;
@@ -83,44 +271,62 @@ bit_vector_t* bit_vector_not(bit_vector_t* pbv){
 
 // ==== see bit_vector.h ========================================
 bit_vector_t* bit_vector_and(bit_vector_t* pbv1, const bit_vector_t* pbv2){
-    if(pbv1 == NULL || pbv1->content == NULL || pbv2 == NULL || pbv2->content == NULL || pbv1->size != pbv2->size) 
+    if(!same_size(pbv1, pbv2))
         return NULL;
 
-    for(int i = 0; i < pbv1->nb_fields; ++i)
-        pbv1->content[i] &= pbv2->content[i];
-
-    REMOVE_TAIL32(pbv1);
-    
+    kernels->and(pbv1->content, pbv2->content, pbv1->nb_fields);
     return pbv1;
 }
 
 // ==== see bit_vector.h ========================================
 bit_vector_t* bit_vector_or(bit_vector_t* pbv1, const bit_vector_t* pbv2){
-    if(pbv1 == NULL || pbv1->content == NULL || pbv2 == NULL || pbv2->content == NULL || pbv1->size != pbv2->size)
+    if(!same_size(pbv1, pbv2))
         return NULL;
 
+    kernels->or(pbv1->content, pbv2->content, pbv1->nb_fields);
+    REMOVE_TAIL32(pbv1);
+    return pbv1;
+}
 
-    for(int i = 0; i < pbv1->nb_fields; ++i)
-        pbv1->content[i] |= pbv2->content[i];
+// ==== see bit_vector.h ========================================
+bit_vector_t* bit_vector_xor(bit_vector_t* pbv1, const bit_vector_t* pbv2){
+    if(!same_size(pbv1, pbv2))
+        return NULL;
 
+    kernels->xor(pbv1->content, pbv2->content, pbv1->nb_fields);
     REMOVE_TAIL32(pbv1);
-    
-    return pbv1; 
+    return pbv1;
 }
 
 // ==== see bit_vector.h ========================================
-bit_vector_t* bit_vector_xor(bit_vector_t* pbv1, const bit_vector_t* pbv2){
-   if(pbv1 == NULL || pbv1->content == NULL || pbv2 == NULL || pbv2->content == NULL || pbv1->size != pbv2->size)
+bit_vector_t* bit_vector_andnot(bit_vector_t* pbv1, const bit_vector_t* pbv2){
+    if(!same_size(pbv1, pbv2))
         return NULL;
 
-    for(int i = 0; i < pbv1->nb_fields; ++i)
-        pbv1->content[i] ^= pbv2->content[i];
+    kernels->andnot(pbv1->content, pbv2->content, pbv1->nb_fields);
+    return pbv1;
+}
 
+// ==== see bit_vector.h ========================================
+bit_vector_t* bit_vector_or_and(bit_vector_t* pbv1, const bit_vector_t* pbv2, const bit_vector_t* pbv3){
+    if(!same_size(pbv1, pbv2) || !same_size(pbv1, pbv3))
+        return NULL;
+
+    kernels->or_and(pbv1->content, pbv2->content, pbv3->content, pbv1->nb_fields);
     REMOVE_TAIL32(pbv1);
-    
     return pbv1;
 }
 
+// ==== see bit_vector.h ========================================
+bit_vector_t* bit_vector_blend(bit_vector_t* output, const bit_vector_t* pbv1, const bit_vector_t* pbv2, const bit_vector_t* mask){
+    if(!same_size(output, pbv1) || !same_size(output, pbv2) || !same_size(output, mask))
+        return NULL;
+
+    kernels->blend(output->content, pbv1->content, pbv2->content, mask->content, output->nb_fields);
+    REMOVE_TAIL32(output);
+    return output;
+}
+
 // ==== see bit_vector.h ========================================
 bit_vector_t* bit_vector_extract_zero_ext(const bit_vector_t* pbv, int64_t index, size_t size){
     if(size == 0)
@@ -128,20 +334,10 @@ bit_vector_t* bit_vector_extract_zero_ext(const bit_vector_t* pbv, int64_t index
 
     bit_vector_t* res = bit_vector_create(size, 0); 
 
-    if(res == NULL ||pbv == NULL || pbv->content == NULL)
+    if(res == NULL || pbv == NULL || pbv->content == NULL)
         return res;
 
-    int i = index < 0 ? -index : 0;
-
-
-    for(int j = i; j < size; ++j){     
-        if(!(j+index >= pbv->size) && (pbv->content[(j + index)/32] & (1 << (j + index))) != 0){
-            res->content[j/32] |= (1 << (j%32)); 
-        }
-    }   
-
-    REMOVE_TAIL32(res);
-    return res;    
+    return bit_vector_extract_zero_ext_into(res, pbv, index);
 }
 
 // ==== see bit_vector.h ========================================
@@ -152,13 +348,7 @@ bit_vector_t* bit_vector_extract_wrap_ext(const bit_vector_t* pbv, int64_t index
     bit_vector_t* res = bit_vector_create(size, 0); 
     if(res == NULL) return NULL;
 
-    for(int i = 0; i < size; ++i){
-        if((pbv->content[((i + index) % pbv->size)/32] & 1 << ((i + index) % pbv->size)) != 0){
-            res->content[i / 32] |= (1 << (i % 32));
-        }
-    }
-
-    return res;
+    return bit_vector_extract_wrap_ext_into(res, pbv, index);
 }
 
 // ==== see bit_vector.h ========================================
@@ -178,23 +368,112 @@ bit_vector_t* bit_vector_join(const bit_vector_t* pbv1, const bit_vector_t* pbv2
     if(res == NULL) 
         return NULL;
 
-    for(int i = 0; i < pbv1->size; i++){
-        uint32_t index = i%32;
+    return bit_vector_join_into(res, pbv1, pbv2, shift);
+}
 
-        //pbv1 values
-        if(i < shift){
-            if((pbv1->content[i/32] & (1 << index)) != 0){
-                res->content[i/32] |= (1 << index);
-            }
+// ==== see bit_vector.h ========================================
+bit_vector_t* bit_vector_cpy_into(bit_vector_t* output, const bit_vector_t* pbv){
+    if(output == NULL || output->content == NULL || pbv == NULL || pbv->content == NULL || output->size != pbv->size)
+        return NULL;
+
+    if(output != pbv)
+        memcpy(output->content, pbv->content, pbv->nb_fields * sizeof(uint32_t));
+
+    return output;
+}
+
+/**
+ * @brief Word k of a bit vector, zero outside of it
+ */
+static inline uint32_t word_at(const bit_vector_t* pbv, int64_t k)
+{
+    return k >= 0 && k < (int64_t) pbv->nb_fields ? pbv->content[k] : 0;
+}
+
+/**
+ * @brief 32 bits of a bit vector starting at bit index, zero outside of it (funnel shift of two words)
+ */
+static inline uint32_t bits_at(const bit_vector_t* pbv, int64_t index)
+{
+    const int64_t k = index >= 0 ? index / 32 : -((31 - index) / 32); // floor(index / 32)
+    const uint64_t pair = word_at(pbv, k) | (uint64_t) word_at(pbv, k + 1) << 32;
+    return (uint32_t) (pair >> (index - k * 32));
+}
 
-        } else{
-            if((pbv2->content[i/32] & (1 << index)) != 0){
-                res->content[i/32] |= (1 << index);
+// ==== see bit_vector.h ========================================
+bit_vector_t* bit_vector_extract_zero_ext_into(bit_vector_t* output, const bit_vector_t* pbv, int64_t index){
+    if(output == NULL || output->content == NULL || pbv == NULL || pbv->content == NULL || output == pbv)
+        return NULL;
+
+    // bits past pbv->size are zero (see REMOVE_TAIL32)
+    for(size_t i = 0; i < output->nb_fields; ++i){
+        output->content[i] = bits_at(pbv, index + (int64_t) i * 32);
+    }
+
+    REMOVE_TAIL32(output);
+    return output;
+}
+
+// ==== see bit_vector.h ========================================
+bit_vector_t* bit_vector_extract_wrap_ext_into(bit_vector_t* output, const bit_vector_t* pbv, int64_t index){
+    if(output == NULL || output->content == NULL || pbv == NULL || pbv->content == NULL || output == pbv)
+        return NULL;
+
+    const int64_t size = (int64_t) pbv->size;
+    int64_t start = index % size;
+    if(start < 0) start += size;
+
+    for(size_t i = 0; i < output->nb_fields; ++i){
+        uint32_t word = 0;
+        if(size >= 32){
+            // the end of pbv, then (if it is less than a word) its beginning
+            word = bits_at(pbv, start);
+            if(size - start < 32) word |= bits_at(pbv, 0) << (size - start);
+            start += 32;
+            if(start >= size) start -= size;
+        } else {
+            // vectors shorter than a word repeat more than once in each word
+            for(size_t j = 0; j < 32; ++j){
+                word |= (uint32_t) ((pbv->content[0] >> start) & 1) << j;
+                if(++start == size) start = 0;
             }
         }
+        output->content[i] = word;
     }
 
-    return res;
+    REMOVE_TAIL32(output);
+    return output;
+}
+
+// ==== see bit_vector.h ========================================
+bit_vector_t* bit_vector_shift_into(bit_vector_t* output, const bit_vector_t* pbv, int64_t shift){
+    if(output == NULL || pbv == NULL || output->size != pbv->size)
+        return NULL;
+
+    return bit_vector_extract_zero_ext_into(output, pbv, -shift);
+}
+
+// ==== see bit_vector.h ========================================
+bit_vector_t* bit_vector_join_into(bit_vector_t* output, const bit_vector_t* pbv1, const bit_vector_t* pbv2, int64_t shift){
+    if(output == NULL || output->content == NULL || pbv1 == NULL || pbv1->content == NULL || pbv2 == NULL || pbv2->content == NULL ||
+       pbv1->size != pbv2->size || output->size != pbv1->size || shift < 0 || shift > pbv1->size) {
+        return NULL;
+    }
+
+    // whole words from pbv1, then the word containing the junction, then whole words from pbv2
+    const size_t junction = (size_t) shift / 32;
+    for(size_t i = 0; i < output->nb_fields; ++i){
+        if(i < junction){
+            output->content[i] = pbv1->content[i];
+        } else if(i > junction){
+            output->content[i] = pbv2->content[i];
+        } else {
+            const uint32_t low = (UINT32_C(1) << (shift % 32)) - 1;
+            output->content[i] = (pbv1->content[i] & low) | (pbv2->content[i] & ~low);
+        }
+    }
+
+    return output;
 }
 
 // ==== see bit_vector.h ========================================
@@ -225,10 +504,9 @@ void bit_vector_free(bit_vector_t** pbv){
     if(pbv == NULL || (*pbv) == NULL) 
         return;
         
-    if((*pbv)->content != NULL)
-        free((*pbv)->content);
-
+    bit_vector_release(*pbv);
     free(*pbv);
+    *pbv = NULL;
     return;
 }
 
@@ -19,14 +19,49 @@ extern "C" {
 
 //=========================================================================
 /**
- * @brief Type to represent image lines
+ * @brief Type to represent image lines.
+ *        Must not be copied by value: the content of a short vector points into its own
+ *        inline_content, which a copy would share (and bit_vector_release() the copy
+ *        would then free what it does not own); copy with bit_vector_cpy() instead.
  */
+#define BIT_VECTOR_INLINE_BITS 256
+#define BIT_VECTOR_INLINE_FIELDS (BIT_VECTOR_INLINE_BITS / 32)
+
 typedef struct{
     size_t size;
     size_t nb_fields;
-    uint32_t* content;
+    uint32_t* content; // inline_content for vectors of at most BIT_VECTOR_INLINE_BITS bits, heap otherwise
+    uint32_t inline_content[BIT_VECTOR_INLINE_FIELDS];
 } bit_vector_t;
 
+//=========================================================================
+/**
+ * @brief Instruction sets the bulk operations (not, and, or, xor, andnot, or_and, blend) can use;
+ *        the best one supported by the CPU is selected at startup
+ */
+typedef enum {
+    BIT_VECTOR_ISA_SCALAR, // portable, 64 bits at a time
+    BIT_VECTOR_ISA_SSE2,
+    BIT_VECTOR_ISA_AVX2,
+    BIT_VECTOR_ISA_COUNT
+} bit_vector_isa_t;
+
+//=========================================================================
+/**
+ * @brief Instruction set currently used by the bulk operations
+ * @return instruction set
+ */
+bit_vector_isa_t bit_vector_isa(void);
+
+//=========================================================================
+/**
+ * @brief Forces the instruction set used by the bulk operations (e.g. to test them all);
+ *        not thread-safe, to be called before any bit vector is used
+ * @param isa instruction set to use
+ * @return Error code (ERR_BAD_PARAMETER if the CPU does not support it)
+ */
+int bit_vector_set_isa(bit_vector_isa_t isa);
+
 //=========================================================================
 /**
  * @brief Create a bit vector of a given size and fill it with bit value
@@ -36,6 +71,25 @@ typedef struct{
  */
 bit_vector_t* bit_vector_create(size_t size, bit_t value);
 
+//=========================================================================
+/**
+ * @brief Initialize a bit vector owned by the caller (e.g. on the stack) and fill it with bit value;
+ *        its content is stored inline up to BIT_VECTOR_INLINE_BITS bits, on the heap beyond
+ *        (see bit_vector_release()). Such a bit vector must not be copied by value.
+ * @param pbv pointer to bit vector to initialize
+ * @param size, size in bits of the vector
+ * @param value, bit value
+ * @return pbv, NULL on error
+ */
+bit_vector_t* bit_vector_init(bit_vector_t* pbv, size_t size, bit_t value);
+
+//=========================================================================
+/**
+ * @brief Release the content of a bit vector initialized by bit_vector_init()
+ * @param pbv pointer to bit vector
+ */
+void bit_vector_release(bit_vector_t* pbv);
+
 //=========================================================================
 /**
  * @brief Create a copy of a bit vector
@@ -88,6 +142,36 @@ bit_vector_t* bit_vector_or(bit_vector_t* pbv1, const bit_vector_t* pbv2);
  */
 bit_vector_t* bit_vector_xor(bit_vector_t* pbv1, const bit_vector_t* pbv2);
 
+//=========================================================================
+/**
+ * @brief And a bit vector with the negation of another one (modifies pbv1)
+ * @param pbv1 pointer to first bit vector
+ * @param pbv2 pointer to second bit vector
+ * @return pbv1 & ~pbv2 (in pbv1)
+ */
+bit_vector_t* bit_vector_andnot(bit_vector_t* pbv1, const bit_vector_t* pbv2);
+
+//=========================================================================
+/**
+ * @brief Or a bit vector with the and of two others, in one pass (modifies pbv1)
+ * @param pbv1 pointer to first bit vector
+ * @param pbv2 pointer to second bit vector
+ * @param pbv3 pointer to third bit vector
+ * @return pbv1 | (pbv2 & pbv3) (in pbv1)
+ */
+bit_vector_t* bit_vector_or_and(bit_vector_t* pbv1, const bit_vector_t* pbv2, const bit_vector_t* pbv3);
+
+//=========================================================================
+/**
+ * @brief Blend two bit vectors by a mask, in one pass (into an existing bit vector)
+ * @param output pointer to bit vector to write to (may be any of the others)
+ * @param pbv1 pointer to bit vector to take the bits not in mask from
+ * @param pbv2 pointer to bit vector to take the bits in mask from
+ * @param mask pointer to mask bit vector
+ * @return (pbv1 & ~mask) | (pbv2 & mask) (in output)
+ */
+bit_vector_t* bit_vector_blend(bit_vector_t* output, const bit_vector_t* pbv1, const bit_vector_t* pbv2, const bit_vector_t* mask);
+
 //=========================================================================
 /**
  * @brief Create a new bit vector extracted from another bit vector (zero extended)
@@ -127,6 +211,56 @@ bit_vector_t* bit_vector_shift(const bit_vector_t* pbv, int64_t shift);
  */
 bit_vector_t* bit_vector_join(const bit_vector_t* pbv1, const bit_vector_t* pbv2, int64_t shift);
 
+//=========================================================================
+/**
+ * @brief Copy a bit vector into an existing one of the same size
+ * @param output pointer to bit vector to write to
+ * @param pbv pointer to bit vector to copy
+ * @return output, NULL on error
+ */
+bit_vector_t* bit_vector_cpy_into(bit_vector_t* output, const bit_vector_t* pbv);
+
+//=========================================================================
+/**
+ * @brief Extract output->size bits of a bit vector into an existing one (zero extended)
+ * @param output pointer to bit vector to write to (distinct from pbv)
+ * @param pbv pointer to bit vector
+ * @param index index from where to start extraction
+ * @return output, NULL on error
+ */
+bit_vector_t* bit_vector_extract_zero_ext_into(bit_vector_t* output, const bit_vector_t* pbv, int64_t index);
+
+//=========================================================================
+/**
+ * @brief Extract output->size bits of a bit vector into an existing one (wrap extended)
+ * @param output pointer to bit vector to write to (distinct from pbv)
+ * @param pbv pointer to bit vector
+ * @param index index from where to start extraction
+ * @return output, NULL on error
+ */
+bit_vector_t* bit_vector_extract_wrap_ext_into(bit_vector_t* output, const bit_vector_t* pbv, int64_t index);
+
+//=========================================================================
+/**
+ * @brief Shift a bit vector into an existing one of the same size
+ * @param output pointer to bit vector to write to (distinct from pbv)
+ * @param pbv pointer to bit vector
+ * @param shift bit shift count
+ * @return output, NULL on error
+ */
+bit_vector_t* bit_vector_shift_into(bit_vector_t* output, const bit_vector_t* pbv, int64_t shift);
+
+//=========================================================================
+/**
+ * @brief Join two bit vectors into an existing one of the same size
+ * @param output pointer to bit vector to write to (may be pbv1 or pbv2)
+ * @param pbv1 pointer to first bit vector
+ * @param pbv2 pointer to second bit vector
+ * @param shift bit shift count
+ * @return output, NULL on error
+ */
+bit_vector_t* bit_vector_join_into(bit_vector_t* output, const bit_vector_t* pbv1, const bit_vector_t* pbv2, int64_t shift);
+
 //=========================================================================
 /**
  * @brief Print bit vector values
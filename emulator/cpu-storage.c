@@ -15,6 +15,14 @@
 #include <inttypes.h> // PRIX8
 #include <stdio.h> // fprintf
 
+// calls the IO sync hook of the cpu (if any) before an access to an IO register, see cpu.h
+#define cpu_sync_io(cpu, addr) \
+    (((cpu)->io_sync != NULL && IS_IO_REGISTER(addr)) ? (cpu)->io_sync((cpu)->io_sync_arg) : ERR_NONE)
+
+// keeps the pending interrupts cache up to date after a write to IE or IF, see cpu.h
+#define cpu_written(cpu, addr) \
+    do { if((addr) == REG_IF || (addr) == REG_IE) cpu_update_pending(cpu); } while(0)
+
 // ==== see cpu-storage.h ========================================
 data_t cpu_read_at_idx(const cpu_t* cpu, addr_t addr)
 {
@@ -22,6 +30,7 @@ data_t cpu_read_at_idx(const cpu_t* cpu, addr_t addr)
         return  DEFAULT_READ_VALUE;
 
     data_t data = 0;
+    M_REQUIRE_NO_ERR(cpu_sync_io(cpu, addr));
     M_REQUIRE_NO_ERR(bus_read(*(cpu->bus), addr, &data)); 
     return data;
 }
@@ -33,6 +42,8 @@ addr_t cpu_read16_at_idx(const cpu_t* cpu, addr_t addr)
         return DEFAULT_READ_VALUE;
         
     addr_t data = 0;
+    M_REQUIRE_NO_ERR(cpu_sync_io(cpu, addr));
+    M_REQUIRE_NO_ERR(cpu_sync_io(cpu, (addr_t) (addr + 1)));
     bus_read16(*cpu->bus, addr, &data);   
     return data;
 }
@@ -43,7 +54,9 @@ int cpu_write_at_idx(cpu_t* cpu, addr_t addr, data_t data)
     M_REQUIRE_NON_NULL(cpu);
     M_REQUIRE_NON_NULL(cpu->bus);
     
+    M_REQUIRE_NO_ERR(cpu_sync_io(cpu, addr));
     M_REQUIRE_NO_ERR(bus_write(*(cpu->bus), addr, data));
+    cpu_written(cpu, addr);
     cpu->write_listener = addr; 
     return ERR_NONE;
 }
@@ -54,7 +67,11 @@ int cpu_write16_at_idx(cpu_t* cpu, addr_t addr, addr_t data16)
     M_REQUIRE_NON_NULL(cpu);
     M_REQUIRE_NON_NULL(cpu->bus);
 
+    M_REQUIRE_NO_ERR(cpu_sync_io(cpu, addr));
+    M_REQUIRE_NO_ERR(cpu_sync_io(cpu, (addr_t) (addr + 1)));
     M_REQUIRE_NO_ERR(bus_write16(*(cpu->bus), addr, data16));
+    cpu_written(cpu, addr);
+    cpu_written(cpu, (addr_t) (addr + 1));
     cpu->write_listener = addr; 
     return ERR_NONE;
 }
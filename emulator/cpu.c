@@ -26,13 +26,6 @@
 */
 int verify_cc(cpu_t* cpu, const instruction_t* lu);
 
-/**
-* @brief check if an interruption is pending if the same bit is 1 in IF and in IE
-* @param cpu cpu to check
-* @return content of REG_IF
-*/
-uint8_t pending_interruptions(cpu_t* cpu);
-
 
 // ==== see cpu.h ========================================
 int cpu_init(cpu_t* cpu)
@@ -282,29 +275,26 @@ static int cpu_dispatch(const instruction_t* lu, cpu_t* cpu)
 static int cpu_do_cycle(cpu_t* cpu)
 {
     M_REQUIRE_NON_NULL(cpu);
-    uint8_t pending = pending_interruptions(cpu);
 
     //if there are pending interruptions
-    if(cpu->IME != 0 && pending != 0){
+    if(cpu->IME != 0 && cpu->pending != 0){
         
         //set IME to zero
         cpu->IME = 0;
 
-        //get the index of rightmost set bit of pending interruptions
-        interrupt_t ir = VBLANK;
-
-        while(bit_get(pending, ir) != 1){
-            ++ir;
-        }
+        //the rightmost set bit of pending interruptions has the highest priority
+        const interrupt_t ir = (interrupt_t) __builtin_ctz(cpu->pending);
 
         //unsetting the corresponding bit in IF
         bit_unset(&(cpu->IF), ir);
+        cpu_update_pending(cpu);
 
         //push current PC address
         cpu_SP_push(cpu, cpu->PC);
 
         //setting the address of instruction handler in PC
         cpu->PC = ir_address(ir);
+        ++cpu->interrupts;
     
         //adding 5 cycles to idle_time
         cpu->idle_time += HANDLING_INTERRUPT;
@@ -323,6 +313,7 @@ static int cpu_do_cycle(cpu_t* cpu)
             instr = &instruction_direct[bin];
         }
         
+        ++cpu->instructions;
         return cpu_dispatch(instr, cpu);
     }
 }
@@ -336,7 +327,8 @@ int cpu_cycle(cpu_t* cpu)
     
     cpu->write_listener = 0;
 
-    if((cpu->HALT == 1 && pending_interruptions(cpu) != 0 && cpu->idle_time == 0) || (cpu->HALT == 0 && cpu->idle_time == 0)){
+    //a halted cpu only wakes up when an interruption is pending
+    if(cpu->idle_time == 0 && (cpu->HALT == 0 || cpu->pending != 0)){
         cpu->HALT = 0;
         return cpu_do_cycle(cpu);
     } 
@@ -352,6 +344,13 @@ int cpu_cycle(cpu_t* cpu)
  */
 void cpu_request_interrupt(cpu_t* cpu, interrupt_t i){
     bit_set(&(cpu->IF), i);
+    cpu_update_pending(cpu);
+}
+
+// ==== see cpu.h ========================================
+void cpu_update_pending(cpu_t* cpu){
+    // IF and IE are backed by the cpu itself: no need for the bus (nor for an IO sync)
+    cpu->pending = cpu->IF & cpu->IE & INTERRUPT_MASK;
 }
 
 
@@ -362,8 +361,3 @@ int verify_cc(cpu_t* cpu, const instruction_t* lu){
 
     return bit_get(cc, 0) == 1 ? (flag != 0) : (flag == 0);
 }
-
-// ==== Tool method ========================================
-uint8_t pending_interruptions(cpu_t* cpu){
-    return (cpu_read_at_idx(cpu, REG_IF) & cpu_read_at_idx(cpu, REG_IE));
-}
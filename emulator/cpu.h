@@ -26,10 +26,18 @@ typedef enum {
 
 #define REG_IF          0xFF0F
 #define REG_IE          0xFFFF
+#define INTERRUPT_MASK  0x1F // one bit per interrupt_t
 #define HIGH_RAM_START   0xFF80
 #define HIGH_RAM_END     0xFFFE
 #define HIGH_RAM_SIZE ((HIGH_RAM_END - HIGH_RAM_START)+1)
 
+//=========================================================================
+/**
+ * @brief Type of the hook called before the CPU accesses an IO register,
+ *        so that the peripherals can be brought up to date first
+ */
+typedef int (*cpu_io_sync_t)(void* arg);
+
 //=========================================================================
 /**
  * @brief Type to represent CPU
@@ -85,6 +93,13 @@ typedef struct{
     addr_t write_listener;
 
     uint8_t idle_time;
+    uint8_t pending; // cached IE & IF (see cpu_update_pending()), non zero iff an interrupt is pending
+
+    cpu_io_sync_t io_sync;
+    void* io_sync_arg;
+
+    uint64_t instructions; // number of instructions executed since cpu_init()
+    uint64_t interrupts;   // number of interrupts serviced since cpu_init()
 }cpu_t;
 
 //=========================================================================
@@ -132,6 +147,16 @@ void cpu_free(cpu_t* cpu);
 void cpu_request_interrupt(cpu_t* cpu, interrupt_t i);
 
 
+/**
+ * @brief Recomputes the cached pending interrupts of the cpu;
+ *        must be called after any write to IE or IF not done through
+ *        cpu_request_interrupt() or the cpu_write_*() functions
+ *
+ * @param cpu cpu to update
+ */
+void cpu_update_pending(cpu_t* cpu);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,217 @@
+/**
+ * @file framesink.c
+ * @brief Streaming of the emulated frames to a file or pipe, as raw video (Y4M or PPM)
+ *
+ * @author E. Wengle, E. Garandel, EPFL
+ * @date 2020
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h> // PRIu64
+#include <pthread.h>
+
+#include "framesink.h"
+#include "gameboy.h" // GB_CYCLES_PER_S
+#include "lcdc.h"    // LCD_WIDTH, LCD_HEIGHT, FRAME_TOTAL_CYCLES
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAME_SIZE (LCD_HEIGHT * LCD_WIDTH)
+
+// frame converted to the format: RGB for PPM, luma then both (subsampled) chroma planes for Y4M
+#define ENCODED_SIZE (3 * FRAME_SIZE)
+#define Y4M_FRAME_SIZE (FRAME_SIZE + 2 * (LCD_HEIGHT / 2) * (LCD_WIDTH / 2))
+
+// grey levels of the colors, 0 being white (full range for PPM, video range for Y4M)
+static const uint8_t PPM_GREY[4] = { 255, 170, 85, 0 };
+static const uint8_t Y4M_LUMA[4] = { 235, 162, 89, 16 };
+
+/**
+ * @brief Converts a frame to the format of a sink and writes it
+ * @param sink sink to write to
+ * @param pixels frame, LCD_HEIGHT lines of LCD_WIDTH colors
+ * @return error code
+ */
+static int framesink_write(framesink_t* sink, const uint8_t* pixels)
+{
+    uint8_t* const out = sink->encoded;
+    int ok = 0;
+    if(sink->format == FRAMESINK_Y4M){
+        for(size_t i = 0; i < FRAME_SIZE; ++i){
+            out[i] = Y4M_LUMA[pixels[i] & 3];
+        }
+        memset(out + FRAME_SIZE, 128, Y4M_FRAME_SIZE - FRAME_SIZE); // no chroma: shades of grey
+        ok = fputs("FRAME\n", sink->output) >= 0 && fwrite(out, Y4M_FRAME_SIZE, 1, sink->output) == 1;
+    } else {
+        for(size_t i = 0; i < FRAME_SIZE; ++i){
+            memset(out + 3 * i, PPM_GREY[pixels[i] & 3], 3);
+        }
+        ok = fprintf(sink->output, "P6\n%d %d\n255\n", LCD_WIDTH, LCD_HEIGHT) > 0 &&
+             fwrite(out, ENCODED_SIZE, 1, sink->output) == 1;
+    }
+    M_REQUIRE(ok, ERR_IO, "%s", "cannot write frame");
+    return ERR_NONE;
+}
+
+/**
+ * @brief Body of the writer thread of a sink: writes the frames of the ring, until asked to quit
+ * @param arg sink (framesink_t)
+ * @return NULL
+ */
+static void* framesink_thread(void* arg)
+{
+    framesink_t* const sink = arg;
+
+    pthread_mutex_lock(&(sink->mutex));
+    while(1){
+        while(!sink->quit && sink->count == 0){
+            pthread_cond_wait(&(sink->ready), &(sink->mutex));
+        }
+        if(sink->count == 0) break; // asked to quit, with nothing left to write
+
+        const uint8_t* const pixels = sink->ring + sink->tail * FRAME_SIZE;
+        const int skip = sink->error != ERR_NONE; // the output already failed
+        pthread_mutex_unlock(&(sink->mutex));
+        const int err = skip ? ERR_NONE : framesink_write(sink, pixels);
+        pthread_mutex_lock(&(sink->mutex));
+        if(err != ERR_NONE){
+            sink->error = err;
+        } else if(!skip){
+            ++sink->nb_written;
+        }
+        sink->tail = (sink->tail + 1) % FRAMESINK_RING_SIZE;
+        --sink->count;
+        pthread_cond_signal(&(sink->space));
+    }
+    pthread_mutex_unlock(&(sink->mutex));
+    return NULL;
+}
+
+// ==== see framesink.h ========================================
+int framesink_open(framesink_t* sink, const char* filename, framesink_format_t format, uint64_t every, int lossless)
+{
+    M_REQUIRE_NON_NULL(sink);
+    M_REQUIRE_NON_NULL(filename);
+    M_REQUIRE(format == FRAMESINK_PPM || format == FRAMESINK_Y4M, ERR_BAD_PARAMETER, "%s", "unknown format");
+    M_REQUIRE(every > 0, ERR_BAD_PARAMETER, "%s", "at least one frame out of every must be written");
+
+    memset(sink, 0, sizeof(framesink_t));
+    sink->format = format;
+    sink->every = every;
+    sink->lossless = lossless;
+    sink->close_output = strcmp(filename, "-") != 0;
+    sink->output = sink->close_output ? fopen(filename, "wb") : stdout;
+    M_REQUIRE(sink->output != NULL, ERR_IO, "cannot open \"%s\"", filename);
+
+    sink->ring = calloc(FRAMESINK_RING_SIZE, FRAME_SIZE);
+    sink->encoded = calloc(1, ENCODED_SIZE);
+    int err = sink->ring == NULL || sink->encoded == NULL ? ERR_MEM : ERR_NONE;
+
+    // the frame rate of the video, of the frames written
+    if(err == ERR_NONE && format == FRAMESINK_Y4M &&
+       fprintf(sink->output, "YUV4MPEG2 W%d H%d F%" PRIu64 ":%" PRIu64 " Ip A1:1 C420jpeg\n", LCD_WIDTH, LCD_HEIGHT,
+               (uint64_t) GB_CYCLES_PER_S, (uint64_t) FRAME_TOTAL_CYCLES * every) < 0){
+        err = ERR_IO;
+    }
+
+    if(err == ERR_NONE){
+        pthread_mutex_init(&(sink->mutex), NULL);
+        pthread_cond_init(&(sink->ready), NULL);
+        pthread_cond_init(&(sink->space), NULL);
+        if(pthread_create(&(sink->thread), NULL, framesink_thread, sink) != 0){
+            pthread_cond_destroy(&(sink->space));
+            pthread_cond_destroy(&(sink->ready));
+            pthread_mutex_destroy(&(sink->mutex));
+            err = ERR_MEM;
+        }
+    }
+
+    if(err != ERR_NONE){
+        if(sink->close_output) fclose(sink->output);
+        free(sink->encoded);
+        free(sink->ring);
+        memset(sink, 0, sizeof(framesink_t));
+    }
+    return err;
+}
+
+// ==== see framesink.h ========================================
+int framesink_push(framesink_t* sink, const uint8_t* pixels)
+{
+    M_REQUIRE_NON_NULL(sink);
+    M_REQUIRE_NON_NULL(pixels);
+    M_REQUIRE_NON_NULL(sink->ring);
+
+    if(sink->nb_pushed++ % sink->every != 0) return ERR_NONE;
+
+    pthread_mutex_lock(&(sink->mutex));
+    // the writer frees a slot even once failed (see framesink_thread())
+    while(sink->lossless && sink->error == ERR_NONE && sink->count == FRAMESINK_RING_SIZE){
+        pthread_cond_wait(&(sink->space), &(sink->mutex));
+    }
+    const int err = sink->error;
+    const int full = sink->count == FRAMESINK_RING_SIZE;
+    if(full){
+        ++sink->nb_dropped;
+    }
+    pthread_mutex_unlock(&(sink->mutex));
+    if(err != ERR_NONE || full) return err;
+
+    // the slot at head is not the writer's until counted
+    memcpy(sink->ring + sink->head * FRAME_SIZE, pixels, FRAME_SIZE);
+    sink->head = (sink->head + 1) % FRAMESINK_RING_SIZE;
+
+    pthread_mutex_lock(&(sink->mutex));
+    ++sink->count;
+    pthread_cond_signal(&(sink->ready));
+    pthread_mutex_unlock(&(sink->mutex));
+    return ERR_NONE;
+}
+
+// ==== see framesink.h ========================================
+int framesink_close(framesink_t* sink)
+{
+    M_REQUIRE_NON_NULL(sink);
+    M_REQUIRE_NON_NULL(sink->ring);
+
+    pthread_mutex_lock(&(sink->mutex));
+    sink->quit = 1;
+    pthread_cond_signal(&(sink->ready));
+    pthread_mutex_unlock(&(sink->mutex));
+    pthread_join(sink->thread, NULL);
+    pthread_cond_destroy(&(sink->space));
+    pthread_cond_destroy(&(sink->ready));
+    pthread_mutex_destroy(&(sink->mutex));
+
+    int err = sink->error;
+    if((sink->close_output ? fclose(sink->output) : fflush(sink->output)) != 0 && err == ERR_NONE){
+        err = ERR_IO;
+    }
+    free(sink->encoded);
+    free(sink->ring);
+    sink->encoded = NULL;
+    sink->ring = NULL;
+    sink->output = NULL;
+    return err;
+}
+
+// ==== see framesink.h ========================================
+int framesink_print_stats(const framesink_t* sink, FILE* output)
+{
+    M_REQUIRE_NON_NULL(sink);
+    M_REQUIRE_NON_NULL(output);
+
+    fprintf(output, "streaming: %" PRIu64 " frames written (one out of %" PRIu64 "), %" PRIu64 " dropped\n",
+            sink->nb_written, sink->every, sink->nb_dropped);
+    return ERR_NONE;
+}
+
+#ifdef __cplusplus
+}
+#endif
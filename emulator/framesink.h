@@ -0,0 +1,108 @@
+#pragma once
+
+/**
+ * @file framesink.h
+ * @brief Streaming of the emulated frames to a file or pipe, as raw video (Y4M or PPM)
+ *
+ * @author E. Wengle, E. Garandel, EPFL
+ * @date 2020
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// frames pushed and not written yet, at most (beyond, frames are waited for or dropped, see framesink_push())
+#define FRAMESINK_RING_SIZE 16
+
+/**
+ * @brief Formats of the stream
+ */
+typedef enum {
+    FRAMESINK_PPM, // binary PPM images (P6), one after the other
+    FRAMESINK_Y4M  // YUV4MPEG2 video, 4:2:0, at the Game Boy frame rate
+} framesink_format_t;
+
+/**
+ * @brief Frame sink type.
+ *        The frames pushed are copied into a bounded ring, from which a writer thread
+ *        converts and writes them: the emulation only waits on the output when the ring is full,
+ *        and then only if the sink is lossless (otherwise, the frame is dropped).
+ */
+typedef struct {
+    FILE* output;
+    int close_output;          // whether output is to be closed (not stdout)
+    framesink_format_t format;
+    uint64_t every;            // one frame written out of every
+    int lossless;              // whether to wait for room in the ring rather than drop frames
+
+    uint8_t* ring;             // FRAMESINK_RING_SIZE frames of LCD_HEIGHT lines of LCD_WIDTH colors
+    uint8_t* encoded;          // frame being written, converted to the format (writer thread)
+    size_t head;               // next slot to fill (emulation thread)
+    size_t tail;               // next slot to write (writer thread)
+    size_t count;              // slots filled and not written yet
+
+    pthread_t thread;
+    pthread_mutex_t mutex;     // protects count, quit, error and the statistics
+    pthread_cond_t ready;      // a frame was pushed, or the sink is closed
+    pthread_cond_t space;      // a frame was written (or skipped), freeing a slot
+    int quit;
+    int error;                 // first error of the writer thread
+
+    uint64_t nb_pushed;        // frames pushed, including those skipped (see every)
+    uint64_t nb_written;
+    uint64_t nb_dropped;       // frames dropped because the ring was full (never if lossless)
+} framesink_t;
+
+
+/**
+ * @brief Opens a frame sink on a file and starts its writer thread
+ *
+ * @param sink sink to open
+ * @param filename name of the file to write to, "-" for the standard output
+ * @param format format of the stream
+ * @param every one frame written out of every (at least 1)
+ * @param lossless whether framesink_push() is to wait for the output rather than drop frames:
+ *        to be set unless the frames are pushed against a real-time deadline
+ * @return error code
+ */
+int framesink_open(framesink_t* sink, const char* filename, framesink_format_t format, uint64_t every, int lossless);
+
+
+/**
+ * @brief Pushes a frame to a sink, without waiting for it to be written. When the ring is full
+ *        (the output is slower than the emulation), waits for a slot to be written if the sink
+ *        is lossless, otherwise drops the frame (see nb_dropped)
+ *
+ * @param sink sink to push to
+ * @param pixels frame, LCD_HEIGHT lines of LCD_WIDTH colors (see lcdc_framebuffer())
+ * @return error code, in particular the first error of the writer thread
+ */
+int framesink_push(framesink_t* sink, const uint8_t* pixels);
+
+
+/**
+ * @brief Writes the frames still in the ring, stops the writer thread and closes a sink
+ *
+ * @param sink sink to close
+ * @return error code, in particular the first error of the writer thread
+ */
+int framesink_close(framesink_t* sink);
+
+
+/**
+ * @brief Prints the statistics of a sink
+ *
+ * @param sink sink to print
+ * @param output stream to print to
+ * @return error code
+ */
+int framesink_print_stats(const framesink_t* sink, FILE* output);
+
+#ifdef __cplusplus
+}
+#endif
@@ -20,6 +20,16 @@
 extern "C" {
 #endif
 
+    /**
+     * @brief IO sync hook of the CPU: brings the peripherals up to date with the current cycle
+     * @param arg gameboy to synchronize
+     * @return error code
+     */
+    static int gameboy_io_sync(void* arg){
+        gameboy_t* gameboy = arg;
+        return gameboy_sync(gameboy, gameboy->cycles + 1);
+    }
+
 
     /**
      * @brief Listens for writes on bus address used by blargg
@@ -66,6 +76,8 @@ extern "C" {
 
         M_REQUIRE_NO_ERR(cpu_init(&(gameboy->cpu)));
         M_REQUIRE_NO_ERR(cpu_plug(&(gameboy->cpu), &(gameboy->bus)));
+        gameboy->cpu.io_sync = gameboy_io_sync;
+        gameboy->cpu.io_sync_arg = gameboy;
         
 
         M_REQUIRE_NO_ERR(lcdc_init(gameboy));
@@ -110,29 +122,113 @@ extern "C" {
     }
 
 
+    // ==== see gameboy.h ========================================
+    int gameboy_sync(gameboy_t* gameboy, uint64_t target_cycle){
+        M_REQUIRE_NON_NULL(gameboy);
+
+        if(gameboy->synced_cycles >= target_cycle)
+            return ERR_NONE;
+
+        // set first: the peripherals access their own registers through the CPU, hence through the sync hook
+        gameboy->synced_cycles = target_cycle;
+        const addr_t write_listener = (gameboy->cpu).write_listener;
+
+        M_REQUIRE_NO_ERR(lcdc_catch_up(&(gameboy->screen), target_cycle));
+        M_REQUIRE_NO_ERR(timer_catch_up(&(gameboy->timer), target_cycle));
+
+        (gameboy->cpu).write_listener = write_listener;
+
+        const uint64_t lcdc_next = lcdc_next_event(&(gameboy->screen));
+        const uint64_t timer_next = timer_next_event(&(gameboy->timer));
+        gameboy->next_sync = lcdc_next < timer_next ? lcdc_next : timer_next;
+
+        return ERR_NONE;
+    }
+
+
     // ==== see gameboy.h ========================================
     int gameboy_run_until(gameboy_t* gameboy, uint64_t cycle){
         M_REQUIRE_NON_NULL(gameboy);
         
         while(gameboy->cycles < cycle){
-           M_REQUIRE_NO_ERR(lcdc_cycle(&(gameboy->screen), gameboy->cycles));
-           M_REQUIRE_NO_ERR(timer_cycle(&(gameboy->timer)));
+           if(gameboy->cycles >= gameboy->next_sync){
+               M_REQUIRE_NO_ERR(gameboy_sync(gameboy, gameboy->cycles + 1));
+           }
+
+           // a halted cpu can only be woken up by an interrupt, which the peripherals
+           // raise no sooner than their next event: jump straight to it
+           const cpu_t* cpu = &(gameboy->cpu);
+           if(cpu->HALT == 1 && cpu->pending == 0 && cpu->idle_time == 0){
+               gameboy->cycles = gameboy->next_sync < cycle ? gameboy->next_sync : cycle;
+               continue;
+           }
+
            M_REQUIRE_NO_ERR(cpu_cycle(&(gameboy->cpu)));
            gameboy->cycles++;
 
-           M_REQUIRE_NO_ERR(bootrom_bus_listener(gameboy, (gameboy->cpu).write_listener));
-           M_REQUIRE_NO_ERR(lcdc_bus_listener(&(gameboy->screen), (gameboy->cpu).write_listener));
-           M_REQUIRE_NO_ERR(timer_bus_listener(&(gameboy->timer), (gameboy->cpu).write_listener));
-           M_REQUIRE_NO_ERR(joypad_bus_listener(&(gameboy->pad), (gameboy->cpu).write_listener));
+           const addr_t addr = (gameboy->cpu).write_listener;
+           if(IS_IO_REGISTER(addr)){
+               M_REQUIRE_NO_ERR(bootrom_bus_listener(gameboy, addr));
+               M_REQUIRE_NO_ERR(lcdc_bus_listener(&(gameboy->screen), addr));
+               M_REQUIRE_NO_ERR(timer_bus_listener(&(gameboy->timer), addr));
+               M_REQUIRE_NO_ERR(joypad_bus_listener(&(gameboy->pad), addr));
+
+                #ifdef BLARGG
+                    M_REQUIRE_NO_ERR(blargg_bus_listener(gameboy, addr));
+                #endif
+
+               // the peripherals may have been reprogrammed: resynchronize on next cycle
+               gameboy->next_sync = gameboy->cycles;
+           } else if(IS_VIDEO_MEMORY(addr)){
+               // the caches and pending lines of the LCDC must follow VRAM and OAM
+               M_REQUIRE_NO_ERR(lcdc_bus_listener(&(gameboy->screen), addr));
+           }
+        }
+        return gameboy_sync(gameboy, gameboy->cycles);
+    } 
+
+// ==== see gameboy.h ========================================
+    int gameboy_run_frame(gameboy_t* gameboy, gameboy_stats_t* stats){
+        M_REQUIRE_NON_NULL(gameboy);
 
+        const uint64_t cycles = gameboy->cycles;
+        const uint64_t instructions = (gameboy->cpu).instructions;
+        const uint64_t interrupts = (gameboy->cpu).interrupts;
 
-            #ifdef BLARGG
-                M_REQUIRE_NO_ERR(blargg_bus_listener(gameboy, (gameboy->cpu).write_listener));
-            #endif
-           
+        uint64_t vblank = lcdc_next_vblank(&(gameboy->screen), gameboy->cycles);
+        if(vblank == UINT64_MAX){
+            vblank = gameboy->cycles + FRAME_TOTAL_CYCLES - 1;
+        }
+        M_REQUIRE_NO_ERR(gameboy_run_until(gameboy, vblank + 1));
+
+        if(stats != NULL){
+            stats->frames = 1;
+            stats->cycles = gameboy->cycles - cycles;
+            stats->instructions = (gameboy->cpu).instructions - instructions;
+            stats->interrupts = (gameboy->cpu).interrupts - interrupts;
         }
         return ERR_NONE;
-    } 
+    }
+
+// ==== see gameboy.h ========================================
+    int gameboy_run_frames(gameboy_t* gameboy, size_t n, gameboy_stats_t* stats){
+        M_REQUIRE_NON_NULL(gameboy);
+
+        gameboy_stats_t total = {0, 0, 0, 0};
+        for(size_t i = 0; i < n; ++i){
+            gameboy_stats_t frame = {0, 0, 0, 0};
+            M_REQUIRE_NO_ERR(gameboy_run_frame(gameboy, &frame));
+            total.frames += frame.frames;
+            total.cycles += frame.cycles;
+            total.instructions += frame.instructions;
+            total.interrupts += frame.interrupts;
+        }
+
+        if(stats != NULL){
+            *stats = total;
+        }
+        return ERR_NONE;
+    }
 
 
 #ifdef __cplusplus
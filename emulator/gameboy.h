@@ -31,6 +31,10 @@ extern "C" {
 /**
  * @brief Game Boy data structure.
  *        Regroups everything needed to simulate the Game Boy.
+ *
+ *        The CPU runs ahead of the peripherals (timer, LCDC), which are only
+ *        brought up to date (see gameboy_sync()) when the CPU touches an IO register
+ *        or when one of them may raise an interrupt.
  */
  
  typedef struct gameboy_ {
@@ -45,6 +49,8 @@ extern "C" {
    bit_t boot;
    lcdc_t screen;
    joypad_t pad;
+   uint64_t synced_cycles; // peripherals are up to date with all the cycles before this one
+   uint64_t next_sync;     // first cycle at which a peripheral may raise an interrupt
 
  } gameboy_t; 
 
@@ -68,6 +74,47 @@ void gameboy_free(gameboy_t* gameboy);
  */
 int gameboy_run_until(gameboy_t* gameboy, uint64_t cycle);
 
+/**
+ * @brief Statistics about frames run by gameboy_run_frame()/gameboy_run_frames()
+ */
+typedef struct {
+    uint64_t frames;       // number of frames run
+    uint64_t cycles;       // number of cycles executed
+    uint64_t instructions; // number of instructions executed
+    uint64_t interrupts;   // number of interrupts serviced
+} gameboy_stats_t;
+
+/**
+ * @brief Runs a game up to (and including) the start of the next VBlank, as signalled
+ *        by the LCDC, i.e. until the current frame is fully drawn.
+ *        When the LCD is off, runs for the duration of a frame instead.
+ *
+ * @param gameboy pointer to gameboy to run
+ * @param stats (modified, may be NULL) statistics about the frame
+ * @return error code
+ */
+int gameboy_run_frame(gameboy_t* gameboy, gameboy_stats_t* stats);
+
+/**
+ * @brief Runs n frames of a game, see gameboy_run_frame()
+ *
+ * @param gameboy pointer to gameboy to run
+ * @param n number of frames to run
+ * @param stats (modified, may be NULL) statistics summed over all the frames run
+ * @return error code
+ */
+int gameboy_run_frames(gameboy_t* gameboy, size_t n, gameboy_stats_t* stats);
+
+/**
+ * @brief Brings the peripherals (timer, LCDC) up to date with the CPU,
+ *        i.e. simulates them for all the cycles before the given one
+ *
+ * @param gameboy pointer to gameboy to synchronize
+ * @param target_cycle first cycle not to simulate
+ * @return error code
+ */
+int gameboy_sync(gameboy_t* gameboy, uint64_t target_cycle);
+
 /**
  * @brief Adresses of the GameBoy
  *
@@ -98,6 +145,14 @@ int gameboy_run_until(gameboy_t* gameboy, uint64_t cycle);
 #define REGISTERS_START  0xFF00
 #define REGISTERS_END    0xFF7F
 
+// true if the address is one of the memory-mapped "IO" registers (or IE)
+#define IS_IO_REGISTER(addr) \
+    (((addr) >= REGISTERS_START && (addr) <= REGISTERS_END) || (addr) == REG_IE)
+
+// true if the address is in VRAM or OAM, the writes to which the LCDC must know about
+#define IS_VIDEO_MEMORY(addr) \
+    (((addr) >= VIDEO_RAM_START && (addr) <= VIDEO_RAM_END) || ((addr) >= GRAPH_RAM_START && (addr) <= GRAPH_RAM_END))
+
 
 // Memory-mapped "IO" registers
 #define BLARGG_REG      0xFF01
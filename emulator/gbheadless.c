@@ -0,0 +1,468 @@
+/**
+ * @file gbheadless.c
+ * @brief Game Boy simulator without display: runs a ROM as fast as possible,
+ *        with scripted input, optionally streaming the frames to a file or pipe,
+ *        publishing them to shared memory (see shmexport.h),
+ *        or writing a hash of each frame (see tests/run_frame_hashes.sh)
+ *
+ * @date 2020
+ */
+
+#include "gameboy.h"
+#include "lcdc.h"
+#include "joypad.h"
+#include "framesink.h"
+#include "shmexport.h"
+#include "error.h"
+#include "util.h" // zero_init_var
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h> // strcasecmp
+#include <errno.h>
+#include <inttypes.h> // PRIu64
+#include <time.h>
+
+#define DEFAULT_FRAMES 600
+
+// maximal length of a line of an input script
+#define SCRIPT_LINE_SIZE 256
+
+// 64-bit FNV-1a hash
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME  0x100000001b3ull
+
+/**
+ * @brief Scripted key event: key pressed or released at the start of the given frame
+ */
+typedef struct {
+    uint64_t frame;
+    gb_key_t key;
+    int pressed;
+} key_event_t;
+
+/**
+ * @brief Input script: key events, by increasing frame
+ */
+typedef struct {
+    key_event_t* events;
+    size_t size;
+    size_t next; // first event not applied yet
+} script_t;
+
+/**
+ * @brief Options of a run
+ */
+typedef struct {
+    uint64_t frames;     // number of frames to run
+    uint64_t cycles;     // number of cycles to run instead, if not 0
+    script_t script;     // key events
+    framesink_t* output; // sink to stream the frames to, NULL if none
+    shmexport_t* shm;    // shared memory to publish the frames to, NULL if none
+    FILE* hashes;        // file to write the hash of each frame to, NULL if none
+    int wram;            // whether the hashes cover work RAM too
+    int pipeline;        // whether the frames are rendered by the pipeline
+} options_t;
+
+static const struct {
+    const char* name;
+    gb_key_t key;
+} KEY_NAMES[] = {
+    { "RIGHT", RIGHT_KEY }, { "LEFT", LEFT_KEY }, { "UP", UP_KEY },         { "DOWN", DOWN_KEY },
+    { "A",     A_KEY },     { "B",    B_KEY },    { "SELECT", SELECT_KEY }, { "START", START_KEY }
+};
+
+// ======================================================================
+static void error(const char* pgm, const char* msg)
+{
+    fputs("ERROR: ", stderr);
+    if (msg != NULL) fputs(msg, stderr);
+    fprintf(stderr, "\nusage:    %s input_file [-f frames | -c cycles] [-i script] [-o output [-n every] [-d]] [-S name] [-H hashes [-w]] [-p | -t threads]\n", pgm);
+    fprintf(stderr, "examples: %s rom.gb -f 3600 -i inputs.txt\n", pgm);
+    fprintf(stderr, "          %s game.gb -c 10000000 -o frames.ppm\n", pgm);
+    fprintf(stderr, "          %s game.gb -f 36000 -o - | ffmpeg -i - game.mp4\n", pgm);
+    fprintf(stderr, "          %s game.gb -f 300 -H game.hashes\n", pgm);
+    fprintf(stderr, "  -f frames: number of frames to run (default: %d)\n", DEFAULT_FRAMES);
+    fputs("  -c cycles: number of cycles to run, instead of frames\n"
+          "  -i script: key events, one per line: \"<frame> press|release <key>\", frames in\n"
+          "             increasing order, keys among UP DOWN LEFT RIGHT A B SELECT START\n"
+          "  -o output: file to stream every frame to, \"-\" for the standard output: as Y4M video\n"
+          "             if its name ends with .y4m or is \"-\", otherwise as binary PPM images\n"
+          "  -n every:  streams one frame out of every (default: 1)\n"
+          "  -d:        drops the frames the output is too slow for, rather than waiting for it\n"
+          "             (fails if any was dropped)\n"
+          "  -S name:   publishes every frame, with the keys pressed, to the shared-memory segment\n"
+          "             of the given name (e.g. /gameboy, see shmexport.h)\n"
+          "  -H hashes: file to write, for each frame run, its number and a hash of the screen, \"-\"\n"
+          "             for the standard output\n"
+          "  -w:        hashes work RAM as well, after the screen\n"
+          "  -p:        renders on a thread of its own, while the next frame is emulated\n"
+          "  -t threads: renders the lines of each frame on that many threads (default: 1)\n", stderr);
+}
+
+// ======================================================================
+/**
+ * @brief Parses a (positive) count given as an option
+ *
+ * @param str option value
+ * @param count (modified) count parsed
+ * @return whether str is a decimal number other than 0
+ */
+static int parse_count(const char* str, uint64_t* count)
+{
+    char* end = NULL;
+    errno = 0;
+    *count = strtoull(str, &end, 10);
+    return errno == 0 && end != str && *end == '\0' && str[0] != '-' && *count > 0;
+}
+
+// ======================================================================
+/**
+ * @brief Reads an input script
+ *
+ * @param filename name of the script file
+ * @param script (modified) script read, to be freed by the caller
+ * @return error code
+ */
+static int script_read(const char* filename, script_t* script)
+{
+    FILE* const file = fopen(filename, "r");
+    M_REQUIRE(file != NULL, ERR_IO, "cannot open script \"%s\"", filename);
+
+    char line[SCRIPT_LINE_SIZE];
+    size_t nb_line = 0;
+    int err = ERR_NONE;
+    while (err == ERR_NONE && fgets(line, sizeof(line), file) != NULL) {
+        ++nb_line;
+        uint64_t frame = 0;
+        char action[16];
+        char name[16];
+        const char* const start = line + strspn(line, " \t\r\n");
+        if (*start == '\0' || *start == '#') {
+            continue; // comment or blank line
+        }
+        const int nb_fields = sscanf(start, "%" SCNu64 " %15s %15s", &frame, action, name);
+
+        key_event_t event = { frame, NB_GB_KEYS, nb_fields == 3 && strcasecmp(action, "press") == 0 };
+        for (size_t i = 0; nb_fields == 3 && i < sizeof(KEY_NAMES) / sizeof(KEY_NAMES[0]); ++i) {
+            if (strcasecmp(name, KEY_NAMES[i].name) == 0) event.key = KEY_NAMES[i].key;
+        }
+        if (event.key == NB_GB_KEYS || (!event.pressed && strcasecmp(action, "release") != 0) ||
+            (script->size > 0 && frame < script->events[script->size - 1].frame)) {
+            fprintf(stderr, "%s:%zu: invalid key event\n", filename, nb_line);
+            err = ERR_BAD_PARAMETER;
+            break;
+        }
+
+        key_event_t* const events = realloc(script->events, (script->size + 1) * sizeof(key_event_t));
+        if (events == NULL) {
+            err = ERR_MEM;
+            break;
+        }
+        script->events = events;
+        script->events[script->size++] = event;
+    }
+
+    fclose(file);
+    return err;
+}
+
+// ======================================================================
+/**
+ * @brief Applies the key events of a script due at the start of the given frame
+ *
+ * @param script script to apply
+ * @param pad joypad to press/release keys of
+ * @param frame frame about to be run
+ * @return error code
+ */
+static int script_apply(script_t* script, joypad_t* pad, uint64_t frame)
+{
+    while (script->next < script->size && script->events[script->next].frame <= frame) {
+        const key_event_t* const e = &(script->events[script->next++]);
+        if (e->pressed) {
+            M_REQUIRE_NO_ERR(joypad_key_pressed(pad, e->key));
+        } else {
+            M_REQUIRE_NO_ERR(joypad_key_released(pad, e->key));
+        }
+    }
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Streams and publishes a frame drawn, as asked for
+ *
+ * @param gb Game Boy
+ * @param opt options of the run
+ * @param pixels frame, LCD_HEIGHT lines of LCD_WIDTH colors
+ * @param frame number of frames run
+ * @return error code
+ */
+static int output_frame(gameboy_t* gb, const options_t* opt, const uint8_t* pixels, uint64_t frame)
+{
+    if (opt->output != NULL) {
+        M_REQUIRE_NO_ERR(framesink_push(opt->output, pixels));
+    }
+    if (opt->shm != NULL) {
+        M_REQUIRE_NO_ERR(shmexport_publish(opt->shm, pixels, frame, &(gb->pad)));
+    }
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Streams and publishes the frames drawn since the last call, as asked for
+ *
+ * @param gb Game Boy
+ * @param opt options of the run
+ * @param frame number of frames run
+ * @return error code
+ */
+static int output_frames(gameboy_t* gb, const options_t* opt, uint64_t frame)
+{
+    if (opt->output == NULL && opt->shm == NULL) return ERR_NONE;
+
+    if (!opt->pipeline) {
+        // as the pipeline, only the frames the LCD was on at the end of (i.e. entered VBlank)
+        const data_t lcdc = *(gb->bus[REG_LCDC]);
+        const data_t ly = *(gb->bus[REG_LY]);
+        return (lcdc & LCDC_REG_LCD_STATUS_MASK) && ly == LCD_HEIGHT ?
+               output_frame(gb, opt, lcdc_framebuffer(&(gb->screen)), frame) : ERR_NONE;
+    }
+
+    static lcdc_framebuffer_t pixels;
+    while (lcdc_pop_frame(&(gb->screen), &pixels, NULL)) {
+        M_REQUIRE_NO_ERR(output_frame(gb, opt, &pixels[0][0], frame));
+    }
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Hashes bytes (64-bit FNV-1a)
+ *
+ * @param hash hash of the bytes before (FNV_OFFSET if none)
+ * @param data bytes to hash
+ * @param size number of bytes
+ * @return hash of the bytes before, then data
+ */
+static uint64_t hash_bytes(uint64_t hash, const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// ======================================================================
+/**
+ * @brief Writes the hashes of the frame just run, if asked for: of the framebuffer
+ *        (whether the LCD is on or not) and of work RAM if opt->wram
+ *
+ * @param gb Game Boy
+ * @param opt options of the run
+ * @param frame number of the frame
+ * @return error code
+ */
+static int write_hashes(gameboy_t* gb, const options_t* opt, uint64_t frame)
+{
+    if (opt->hashes == NULL) return ERR_NONE;
+
+    // the framebuffer of the LCD controler is only up to date once the pipeline is waited for,
+    // or the lines captured by the rendering threads are rendered
+    M_REQUIRE_NO_ERR(lcdc_flush(&(gb->screen)));
+    const uint64_t screen = hash_bytes(FNV_OFFSET, lcdc_framebuffer(&(gb->screen)), LCD_WIDTH * LCD_HEIGHT);
+    int ok = fprintf(opt->hashes, "%" PRIu64 " %016" PRIx64, frame, screen) > 0;
+
+    if (opt->wram) {
+        uint64_t wram = FNV_OFFSET;
+        for (addr_t a = WORK_RAM_START; a <= WORK_RAM_END; ++a) {
+            wram = hash_bytes(wram, gb->bus[a], 1);
+        }
+        ok = ok && fprintf(opt->hashes, " %016" PRIx64, wram) > 0;
+    }
+    M_REQUIRE(ok && fputc('\n', opt->hashes) != EOF, ERR_IO, "%s", "cannot write hashes");
+    return ERR_NONE;
+}
+
+// ======================================================================
+/**
+ * @brief Runs the Game Boy frame by frame (applying the script at the start of each),
+ *        up to opt->frames frames, or opt->cycles cycles if not 0
+ *
+ * @param gb Game Boy to run
+ * @param opt options of the run
+ * @param nb_frames (modified) number of frames run
+ * @return error code
+ */
+static int run(gameboy_t* gb, options_t* opt, uint64_t* nb_frames)
+{
+    const uint64_t cycles = opt->cycles;
+    for (*nb_frames = 0; cycles > 0 ? gb->cycles < cycles : *nb_frames < opt->frames; ++*nb_frames) {
+        M_REQUIRE_NO_ERR(script_apply(&(opt->script), &(gb->pad), *nb_frames));
+
+        // end of the frame as gameboy_run_frame() runs it, LCD off included
+        uint64_t vblank = lcdc_next_vblank(&(gb->screen), gb->cycles);
+        if (vblank == UINT64_MAX) vblank = gb->cycles + FRAME_TOTAL_CYCLES - 1;
+        if (cycles > 0 && vblank >= cycles) {
+            // the last frame is not complete
+            M_REQUIRE_NO_ERR(gameboy_run_until(gb, cycles));
+            break;
+        }
+
+        M_REQUIRE_NO_ERR(gameboy_run_frame(gb, NULL));
+        M_REQUIRE_NO_ERR(output_frames(gb, opt, *nb_frames + 1));
+        M_REQUIRE_NO_ERR(write_hashes(gb, opt, *nb_frames));
+    }
+
+    if (opt->pipeline) {
+        // the frames still being rendered
+        M_REQUIRE_NO_ERR(lcdc_flush(&(gb->screen)));
+        M_REQUIRE_NO_ERR(output_frames(gb, opt, *nb_frames));
+    }
+    return ERR_NONE;
+}
+
+// ======================================================================
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        error(argv[0], "please provide input_file");
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+    options_t opt;
+    zero_init_var(opt);
+    opt.frames = DEFAULT_FRAMES;
+    const char* script_name = NULL;
+    const char* output_name = NULL;
+    const char* hashes_name = NULL;
+    const char* shm_name = NULL;
+    uint64_t every = 1;
+    uint64_t threads = 1;
+    int lossless = 1; // no real-time deadline: the emulation rather waits for the output
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "-p") == 0) {
+            opt.pipeline = 1;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            lossless = 0;
+        } else if (strcmp(argv[i], "-w") == 0) {
+            opt.wram = 1;
+        } else if (i + 1 < argc && strcmp(argv[i], "-f") == 0) {
+            if (!parse_count(argv[++i], &(opt.frames))) {
+                error(argv[0], "invalid number of frames");
+                return 1;
+            }
+        } else if (i + 1 < argc && strcmp(argv[i], "-t") == 0) {
+            if (!parse_count(argv[++i], &threads) || threads > LCD_HEIGHT) {
+                error(argv[0], "invalid number of threads");
+                return 1;
+            }
+        } else if (i + 1 < argc && strcmp(argv[i], "-c") == 0) {
+            if (!parse_count(argv[++i], &(opt.cycles))) {
+                error(argv[0], "invalid number of cycles");
+                return 1;
+            }
+        } else if (i + 1 < argc && strcmp(argv[i], "-S") == 0) {
+            shm_name = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "-H") == 0) {
+            hashes_name = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "-i") == 0) {
+            script_name = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "-o") == 0) {
+            output_name = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+            if (!parse_count(argv[++i], &every)) {
+                error(argv[0], "invalid number of frames for -n");
+                return 1;
+            }
+        } else {
+            error(argv[0], "invalid option");
+            return 1;
+        }
+    }
+    if (opt.pipeline && threads > 1) {
+        error(argv[0], "the rendering pipeline renders with a single thread");
+        return 1;
+    }
+    if (output_name != NULL && hashes_name != NULL &&
+        strcmp(output_name, "-") == 0 && strcmp(hashes_name, "-") == 0) {
+        error(argv[0], "the frames and the hashes cannot both be written to the standard output");
+        return 1;
+    }
+
+    int err = script_name == NULL ? ERR_NONE : script_read(script_name, &(opt.script));
+
+    framesink_t sink;
+    if (err == ERR_NONE && output_name != NULL) {
+        const size_t len = strlen(output_name);
+        const framesink_format_t format = strcmp(output_name, "-") == 0 ||
+                                          (len >= 4 && strcasecmp(output_name + len - 4, ".y4m") == 0) ?
+                                          FRAMESINK_Y4M : FRAMESINK_PPM;
+        err = framesink_open(&sink, output_name, format, every, lossless);
+        if (err == ERR_NONE) opt.output = &sink;
+    }
+
+    shmexport_t shm;
+    if (err == ERR_NONE && shm_name != NULL) {
+        err = shmexport_open(&shm, shm_name);
+        if (err == ERR_NONE) opt.shm = &shm;
+    }
+
+    if (err == ERR_NONE && hashes_name != NULL) {
+        opt.hashes = strcmp(hashes_name, "-") == 0 ? stdout : fopen(hashes_name, "w");
+        if (opt.hashes == NULL) err = ERR_IO;
+    }
+
+    gameboy_t* const gb = err == ERR_NONE ? calloc(1, sizeof(gameboy_t)) : NULL;
+    if (err == ERR_NONE) {
+        err = gb == NULL ? ERR_MEM : gameboy_create(gb, filename);
+    }
+    if (err == ERR_NONE && opt.pipeline) {
+        err = lcdc_set_pipeline(&(gb->screen), 1);
+    }
+    if (err == ERR_NONE && threads > 1) {
+        err = lcdc_set_render_threads(&(gb->screen), (size_t) threads);
+    }
+
+    uint64_t nb_frames = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (err == ERR_NONE) {
+        err = run(gb, &opt, &nb_frames);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (err == ERR_NONE) {
+        const double s = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+        fprintf(stderr, "%" PRIu64 " frames, %" PRIu64 " cycles in %.3f s: %.1f frames/s, %.1fx real time\n",
+                nb_frames, gb->cycles, s, (double) nb_frames / s, (double) gb->cycles / GB_CYCLES_PER_S / s);
+    }
+
+    if (gb != NULL) gameboy_free(gb);
+    free(gb);
+    if (opt.output != NULL) {
+        const int close_err = framesink_close(opt.output);
+        framesink_print_stats(opt.output, stderr);
+        if (err == ERR_NONE) err = close_err;
+        if (err == ERR_NONE && opt.output->nb_dropped > 0) {
+            fprintf(stderr, "ERROR: %" PRIu64 " frames dropped, the output being too slow\n", opt.output->nb_dropped);
+            err = ERR_IO;
+        }
+    }
+    if (opt.shm != NULL && shmexport_close(opt.shm) != ERR_NONE && err == ERR_NONE) {
+        err = ERR_IO;
+    }
+    if (opt.hashes != NULL && (opt.hashes == stdout ? fflush(opt.hashes) : fclose(opt.hashes)) != 0 && err == ERR_NONE) {
+        err = ERR_IO;
+    }
+    free(opt.script.events);
+
+    if (err != ERR_NONE) {
+        fprintf(stderr, "ERROR: run of \"%s\" failed (error code %d)\n", filename, err);
+    }
+    return err;
+}
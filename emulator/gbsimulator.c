@@ -1,10 +1,12 @@
 #include <stdint.h>
+#include <string.h> // memcpy, memset, strcmp
 #include "sidlib.h"
 #include "lcdc.h"
 #include "gameboy.h"
 #include "error.h"
 #include "util.h"
-#include <sys/time.h> 
+#include "pacer.h"
+#include "shmexport.h"
 // Key press bits
 #define MY_KEY_UP_BIT       0x01
 #define MY_KEY_DOWN_BIT     0x02
@@ -16,54 +18,79 @@
 #define MY_KEY_SELECT_BIT   0x40
 
 #define SCALE_FACTOR     4
+
+// the image is refreshed on every frame of the display, which drives the emulation
+// when at the same rate, and is resampled otherwise (see pacer_tick())
+#define REFRESH_MS       SD_FRAME_CLOCK
+
+// maximal number of frames emulated by a single refresh when late (e.g. after a stall)
+#define MAX_CATCH_UP_FRAMES 4
+
 gameboy_t gb;
-struct timeval start;
-struct timeval paused;
+pacer_t pacer;
+simple_image_displayer_t* display = NULL;
+int paused = 0;
 
-/**
- * @brief Sets a pixel from a two-dimensional set of pixels with an indicated grey value
- *
- * @param pixels Set of pixels
- * @param row row index
- * @param col column index
- * @param width with of a single row
- * @param grey indiccated grey value
- */
-static void set_grey(guchar* pixels, int row, int col, int width, guchar grey)
-{
-    if(pixels == NULL) 
-        return;
+// whether the screen is rendered by a thread of its own (see lcdc_set_pipeline())
+bit_t pipeline = 0;
+lcdc_framebuffer_t frame; // last frame completed by the pipeline
+bit_t dirty[LCD_HEIGHT];  // lines of the display changed since last blitted
 
-    const size_t i = (size_t) (3 * (row * width + col)); // 3 = RGB
-    pixels[i+2] = pixels[i+1] = pixels[i] = grey;
-}
+// shared memory the frames displayed are published to (see shmexport.h), NULL if none
+shmexport_t shm;
+shmexport_t* shared = NULL;
+uint64_t frames_run = 0;
+
+// size of a pixel of the display once scaled, in RGB bytes
+#define SCALED_PIXEL_SIZE (3 * SCALE_FACTOR)
 
 /**
- * @brief Computes how many gameboy cycles have elapsed since the given period
+ * @brief Blits the lines of the display changed into RGB pixels, scaled by SCALE_FACTOR:
+ *        each of them is converted once, through a lookup table of its scaled pixels,
+ *        then copied to the SCALE_FACTOR lines of the window it covers
  *
- * @param from Original period
- * @return Number of gameboy cycles that have elapsed
+ * @param pixels RGB pixels of the window, LCD_HEIGHT * SCALE_FACTOR lines of
+ *        LCD_WIDTH * SCALE_FACTOR pixels
+ * @param screen display, LCD_HEIGHT lines of LCD_WIDTH colors (0 to 3, 0 being white)
+ * @param changed (modified) LCD_HEIGHT flags of the lines to blit, cleared
+ * @param first (modified) first line blitted
+ * @param end (modified) last line blitted (excluded), first if none
  */
-uint64_t get_time_in_GB_cycles_since(struct timeval* from)
+static void blit_screen(guchar* pixels, const uint8_t* screen, bit_t* changed, size_t* first, size_t* end)
 {
-    if(from == NULL)
-        return 0;
-
-    struct timeval now;
-    gettimeofday(&now, NULL);
+    static guchar scaled[4][SCALED_PIXEL_SIZE];
+    static int lut_ready = 0;
+    if(!lut_ready){
+        for(int color = 0; color < 4; ++color){
+            memset(scaled[color], 255 - 85 * color, SCALED_PIXEL_SIZE);
+        }
+        lut_ready = 1;
+    }
 
-    if(!timercmp(&now, from, >)){
-        return 0;
+    const size_t row_size = (size_t) LCD_WIDTH * SCALED_PIXEL_SIZE;
+    *first = *end = 0;
+    for(size_t y = 0; y < LCD_HEIGHT; ++y){
+        if(!changed[y]) continue;
+        changed[y] = 0;
+        if(*first == *end) *first = y;
+        *end = y + 1;
+
+        guchar* const row = pixels + y * SCALE_FACTOR * row_size;
+        const uint8_t* const line = screen + y * LCD_WIDTH;
+        for(size_t x = 0; x < LCD_WIDTH; ++x){
+            memcpy(row + x * SCALED_PIXEL_SIZE, scaled[line[x] & 3], SCALED_PIXEL_SIZE);
+        }
+        for(size_t r = 1; r < SCALE_FACTOR; ++r){
+            memcpy(row + r * row_size, row, row_size);
+        }
     }
-    
-    struct timeval delta;
-    timersub(&now, from, &delta);
-    uint64_t v =  delta.tv_sec * GB_CYCLES_PER_S + (delta.tv_usec * GB_CYCLES_PER_S) / 1000000;
-    return v;
 }
 
 /**
- * @brief Generates an image for the gameboys screen
+ * @brief Emulates the frames due on this refresh of the display (see pacer_tick()),
+ *        or, without frame clock, the next frame once its deadline is reached (see pacer_wait()),
+ *        at most MAX_CATCH_UP_FRAMES when late, and generates an image for the
+ *        gameboys screen; only the last emulated frame is rendered
  *
  * @param pixels set of pixels to be set
  * @param height height of the window to be displayed
@@ -71,19 +98,34 @@ uint64_t get_time_in_GB_cycles_since(struct timeval* from)
  */
 static void generate_image(guchar* pixels, int height, int width)
 {   
-    if(pixels == NULL)
+    if(pixels == NULL || height != LCD_HEIGHT * SCALE_FACTOR || width != LCD_WIDTH * SCALE_FACTOR)
         return;
     
-    if(gameboy_run_until(&gb, get_time_in_GB_cycles_since(&start)) != ERR_NONE)
+    uint64_t nb_frames = 0;
+    const int err = display->frame_time > 0
+                    ? pacer_tick(&pacer, (uint64_t) display->frame_time * 1000, (uint64_t) display->refresh_interval * 1000,
+                                 MAX_CATCH_UP_FRAMES, &nb_frames)
+                    : pacer_wait(&pacer, MAX_CATCH_UP_FRAMES, &nb_frames);
+    if(err != ERR_NONE || (nb_frames > 0 && gameboy_run_frames(&gb, nb_frames, NULL) != ERR_NONE))
         return;
+    frames_run += nb_frames;
+
+    const uint8_t* screen = lcdc_framebuffer(&(gb.screen));
+    if(pipeline){
+        // the latest frame completed so far, the frame being emulated is rendered meanwhile
+        while(lcdc_pop_frame(&(gb.screen), &frame, dirty));
+        screen = &(frame[0][0]);
+    } else {
+        lcdc_take_dirty_lines(&(gb.screen), dirty);
+    }
+    if(shared != NULL && nb_frames > 0){
+        shmexport_publish(shared, screen, frames_run, &(gb.pad));
+    }
 
-    uint8_t pixelval = 0;
-    for(int i = 0; i < width; ++i){
-        for(int j = 0; j < height; ++j){
-            image_get_pixel(&pixelval, &(gb.screen.display), i/SCALE_FACTOR, j/SCALE_FACTOR);
-            set_grey(pixels,  j, i, width, 255 - 85 * pixelval);
-        }
-    } 
+    // static scenes are not presented again
+    size_t first = 0, end = 0;
+    blit_screen(pixels, screen, dirty, &first, &end);
+    sd_set_dirty_rows(display, (int) first * SCALE_FACTOR, (int) end * SCALE_FACTOR);
 }
 
 // registers a key-press
@@ -152,13 +194,11 @@ static gboolean keypress_handler(guint keyval, gpointer data)
         M_REQUIRE_NO_ERR(joypad_key_pressed(&(gb.pad), SELECT_KEY));
         return TRUE;
     case GDK_KEY_space:
-        {
-            puts("PAUSE key pressed");
-            struct timeval now;
-            gettimeofday(&now, NULL);
-            timersub(&now, &paused, &paused);
-            timeradd(&start, &paused, &start);
-            timerclear(&paused);
+        puts("PAUSE key pressed");
+        paused = !paused;
+        if(!paused){
+            // the emulation restarts where it was paused, without catching up
+            M_REQUIRE_NO_ERR(pacer_restart(&pacer));
         }
     }
 
@@ -250,8 +290,11 @@ static void error(const char* pgm, const char* msg)
 {
     fputs("ERROR: ", stderr);
     if (msg != NULL) fputs(msg, stderr);
-    fprintf(stderr, "\nusage:    %s input_file\n", pgm);
+    fprintf(stderr, "\nusage:    %s input_file [--pipeline] [--shm name]\n", pgm);
     fprintf(stderr, "example: %s rom.gb\n", pgm);
+    fputs("--pipeline: renders the screen on a thread of its own, while the next frame is emulated\n", stderr);
+    fputs("--shm name: publishes the frames displayed, with the keys pressed, to the shared-memory\n"
+          "            segment of the given name (e.g. /gameboy, see shmexport.h)\n", stderr);
 }
 
 
@@ -271,21 +314,46 @@ int main(int argc, char *argv[])
     }
 
     const char* const filename = argv[1];
+    const char* shm_name = NULL;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--pipeline") == 0) {
+            pipeline = 1;
+        } else if (i + 1 < argc && strcmp(argv[i], "--shm") == 0) {
+            shm_name = argv[++i];
+        } else {
+            error(argv[0], "unknown option");
+            return 1;
+        }
+    }
     zero_init_var(gb);
 
     int err = gameboy_create(&gb, filename);
+    if (err == ERR_NONE && pipeline) {
+        err = lcdc_set_pipeline(&(gb.screen), 1);
+    }
     if (err != ERR_NONE) {
         gameboy_free(&gb);
         return err;
     }
 
-    timerclear(&paused);
-    gettimeofday(&start, NULL);
-
+    err = pacer_init(&pacer);
+    if (err == ERR_NONE && shm_name != NULL) {
+        err = shmexport_open(&shm, shm_name);
+        if (err == ERR_NONE) shared = &shm;
+    }
+    if (err != ERR_NONE) {
+        gameboy_free(&gb);
+        return err;
+    }
 
-    sd_launch(&argc, &argv, sd_init("Gameboy", LCD_WIDTH * SCALE_FACTOR, LCD_HEIGHT * SCALE_FACTOR, 40,
-                        generate_image, keypress_handler, keyrelease_handler));
+    display = sd_init("Gameboy", LCD_WIDTH * SCALE_FACTOR, LCD_HEIGHT * SCALE_FACTOR, REFRESH_MS,
+                      generate_image, keypress_handler, keyrelease_handler);
+    sd_launch(&argc, &argv, display); // frees display
 
+    pacer_print_stats(&pacer, stderr);
+    if (shared != NULL) {
+        shmexport_close(shared);
+    }
     gameboy_free(&gb);
 
     return err;
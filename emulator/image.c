@@ -93,13 +93,10 @@ int image_line_shift(image_line_t* output, image_line_t iml, int64_t shift)
     M_REQUIRE_NON_NULL(output);
     M_REQUIRE_NON_NULL_IMAGE_LINE(iml);
 
-#define do(I, X) \
-    I->X = bit_vector_shift(iml.X, shift)
+    M_REQUIRE_NO_ERR(image_line_create(output, iml.msb->size));
+    M_EXIT_IF_ERR_DO_SOMETHING(image_line_shift_into(output, iml, shift), image_line_free(output));
 
-    do_image_line(output);
-#undef do
-
-    return valid(output);
+    return ERR_NONE;
 }
 
 // ======================================================================
@@ -109,174 +106,229 @@ int image_line_extract_wrap_ext(image_line_t* output, image_line_t iml, int64_t
     M_REQUIRE_NON_NULL_IMAGE_LINE(iml);
     M_REQUIRE(size > 0, ERR_BAD_PARAMETER, "%s", "Size argument cannot be zero");
 
+    M_REQUIRE_NO_ERR(image_line_create(output, size));
+    M_EXIT_IF_ERR_DO_SOMETHING(image_line_extract_wrap_ext_into(output, iml, index), image_line_free(output));
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+int image_line_map_colors(image_line_t* output, image_line_t iml, palette_t map)
+{
+    M_REQUIRE_NON_NULL(output);
+    M_REQUIRE_NON_NULL_IMAGE_LINE(iml);
+
+    M_REQUIRE_NO_ERR(image_line_create(output, iml.msb->size));
+    M_EXIT_IF_ERR_DO_SOMETHING(image_line_map_colors_into(output, iml, map), image_line_free(output));
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+int image_line_below_with_opacity(image_line_t* output, image_line_t iml1, image_line_t iml2, bit_vector_t* p_opacity)
+{
+    M_REQUIRE_NON_NULL(output);
+    M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(iml1, iml2);
+
+    M_REQUIRE_NO_ERR(image_line_create(output, iml1.msb->size));
+    M_EXIT_IF_ERR_DO_SOMETHING(image_line_below_with_opacity_into(output, iml1, iml2, p_opacity), image_line_free(output));
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+int image_line_below(image_line_t* output, image_line_t iml1, image_line_t iml2)
+{
+    M_REQUIRE_NON_NULL(output);
+    M_REQUIRE_NON_NULL_IMAGE_LINE(iml1);
+    M_REQUIRE_NON_NULL_IMAGE_LINE(iml2);
+    M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(iml1, iml2);
+
+    return image_line_below_with_opacity(output, iml1, iml2, iml2.opacity);
+}
+
+// ======================================================================
+int image_line_join(image_line_t* output, image_line_t iml1, image_line_t iml2, int64_t start)
+{
+    M_REQUIRE_NON_NULL(output);
+    M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(iml1, iml2);
+
+    M_REQUIRE_NO_ERR(image_line_create(output, iml1.msb->size));
+    M_EXIT_IF_ERR_DO_SOMETHING(image_line_join_into(output, iml1, iml2, start), image_line_free(output));
+
+    return ERR_NONE;
+}
+
+// ======================================================================
+#define M_REQUIRE_BIT_VECTOR(call) \
+    M_REQUIRE((call) != NULL, ERR_BAD_PARAMETER, "%s failed", #call)
+
+// ======================================================================
+int image_line_shift_into(image_line_t* output, image_line_t iml, int64_t shift)
+{
+    M_REQUIRE_NON_NULL(output);
+    M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(*output, iml);
+
 #define do(I, X) \
-    I->X = bit_vector_extract_wrap_ext(iml.X, index, size)
+    M_REQUIRE_BIT_VECTOR(bit_vector_shift_into(I->X, iml.X, shift))
 
     do_image_line(output);
 #undef do
 
-    return valid(output);
+    return ERR_NONE;
 }
 
 // ======================================================================
-#define PALETTE_MASK_BIT 0x01
-
-int image_line_map_colors(image_line_t* output, image_line_t iml, palette_t map)
+int image_line_extract_wrap_ext_into(image_line_t* output, image_line_t iml, int64_t index)
 {
     M_REQUIRE_NON_NULL(output);
+    M_REQUIRE_NON_NULL_IMAGE_LINE(*output);
     M_REQUIRE_NON_NULL_IMAGE_LINE(iml);
 
-    if (map == DEFAULT_PALETTE) {
 #define do(I, X) \
-        I->X = bit_vector_cpy(iml.X)
+    M_REQUIRE_BIT_VECTOR(bit_vector_extract_wrap_ext_into(I->X, iml.X, index))
 
-        do_image_line(output);
+    do_image_line(output);
 #undef do
-        return ERR_NONE;
-    }
 
-    output->lsb = bit_vector_create(iml.lsb->size, 0);
-    output->msb = bit_vector_create(iml.msb->size, 0);
-    output->opacity = bit_vector_cpy(iml.opacity);
-
-    for (size_t i = 0; i < PALETTE_COLOR_COUNT; ++i) {
-        bit_vector_t* mask = NULL;
-
-        switch (i) {
-        case 0: {
-            bit_vector_t* tmp = bit_vector_not(bit_vector_cpy(iml.lsb));
+    return ERR_NONE;
+}
 
-            if (tmp == NULL) {
-                image_line_free(output);
-                return ERR_MEM;
-            }
+// ======================================================================
+#define PALETTE_MASK_BIT 0x01
 
-            mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.msb)), tmp);
-            bit_vector_free(&tmp);
-        } break;
+/**
+ * @brief Planes of a palette as bitwise formulas: with m and l the msb and lsb words
+ *        of a line, each output plane word is a[0] ^ (a[1] & l) ^ (a[2] & m) ^ (a[3] & m & l)
+ *        (algebraic normal form of the plane's truth table over the four colors)
+ */
+typedef struct {
+    uint32_t msb[PALETTE_COLOR_COUNT];
+    uint32_t lsb[PALETTE_COLOR_COUNT];
+} palette_planes_t;
 
-        case 1: {
-            mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.msb)), iml.lsb);
-        } break;
+/**
+ * @brief Computes the coefficients of one plane from its truth table t (bit i: value for color i)
+ */
+static void palette_plane(uint32_t a[PALETTE_COLOR_COUNT], unsigned t)
+{
+    const unsigned t0 = t & 1, t1 = (t >> 1) & 1, t2 = (t >> 2) & 1, t3 = (t >> 3) & 1;
+    a[0] = -(uint32_t) t0;
+    a[1] = -(uint32_t) (t0 ^ t1);
+    a[2] = -(uint32_t) (t0 ^ t2);
+    a[3] = -(uint32_t) (t0 ^ t1 ^ t2 ^ t3);
+}
 
-        case 2: {
-            mask = bit_vector_and(bit_vector_not(bit_vector_cpy(iml.lsb)), iml.msb);
-        } break;
+/**
+ * @brief Derives the plane formulas of a palette
+ */
+static palette_planes_t palette_planes(palette_t map)
+{
+    unsigned t_msb = 0, t_lsb = 0;
+    for (unsigned i = 0; i < PALETTE_COLOR_COUNT; ++i) {
+        t_lsb |= ((map >> (i * 2)) & PALETTE_MASK_BIT) << i;
+        t_msb |= ((map >> (i * 2 + 1)) & PALETTE_MASK_BIT) << i;
+    }
 
-        case 3: {
-            mask = bit_vector_and(bit_vector_cpy(iml.lsb), iml.msb);
-        } break;
-        }
+    palette_planes_t p;
+    palette_plane(p.msb, t_msb);
+    palette_plane(p.lsb, t_lsb);
+    return p;
+}
 
-        if (mask == NULL) {
-            image_line_free(output);
-            return ERR_MEM;
-        }
+#define palette_apply(a, m, l) ((a)[0] ^ ((a)[1] & (l)) ^ ((a)[2] & (m)) ^ ((a)[3] & (m) & (l)))
 
-        if (map & (PALETTE_MASK_BIT << (i * 2))) {
-            output->lsb = bit_vector_or(output->lsb, mask);
+int image_line_map_colors_into(image_line_t* output, image_line_t iml, palette_t map)
+{
+    M_REQUIRE_NON_NULL(output);
+    M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(*output, iml);
 
-            if (output->lsb == NULL) {
-                image_line_free(output);
-                return ERR_MEM;
-            }
+    const bit_t in_place = output->msb == iml.msb && output->lsb == iml.lsb && output->opacity == iml.opacity;
+    if (map == DEFAULT_PALETTE) {
+        // identity: the line itself is its own mapping
+        if (!in_place) {
+            M_REQUIRE_BIT_VECTOR(bit_vector_cpy_into(output->msb, iml.msb));
+            M_REQUIRE_BIT_VECTOR(bit_vector_cpy_into(output->lsb, iml.lsb));
+            M_REQUIRE_BIT_VECTOR(bit_vector_cpy_into(output->opacity, iml.opacity));
         }
+        return ERR_NONE;
+    }
 
-        if (map & (PALETTE_MASK_BIT << ((i * 2) + 1))) {
-            output->msb = bit_vector_or(output->msb, mask);
+    if (output->opacity != iml.opacity) {
+        M_REQUIRE_BIT_VECTOR(bit_vector_cpy_into(output->opacity, iml.opacity));
+    }
 
-            if (output->msb == NULL) {
-                image_line_free(output);
-                return ERR_MEM;
-            }
-        }
+    const palette_planes_t p = palette_planes(map);
+    const uint32_t* const msb = iml.msb->content;
+    const uint32_t* const lsb = iml.lsb->content;
+    uint32_t* const out_msb = output->msb->content;
+    uint32_t* const out_lsb = output->lsb->content;
+
+    const size_t nb_fields = iml.msb->nb_fields;
+    for (size_t w = 0; w < nb_fields; ++w) {
+        const uint32_t m = msb[w];
+        const uint32_t l = lsb[w];
+        out_msb[w] = palette_apply(p.msb, m, l);
+        out_lsb[w] = palette_apply(p.lsb, m, l);
+    }
 
-        bit_vector_free(&mask);
+    // color 0 also covers the unused bits of the last word
+    const size_t tail = iml.msb->size % IMAGE_LINE_WORD_BITS;
+    if (tail != 0) {
+        out_msb[nb_fields - 1] &= (UINT32_C(1) << tail) - 1;
+        out_lsb[nb_fields - 1] &= (UINT32_C(1) << tail) - 1;
     }
 
     return ERR_NONE;
 }
 
 // ======================================================================
-int image_line_below_with_opacity(image_line_t* output, image_line_t iml1, image_line_t iml2, bit_vector_t* p_opacity)
+int image_line_below_with_opacity_into(image_line_t* output, image_line_t iml1, image_line_t iml2, const bit_vector_t* p_opacity)
 {
     M_REQUIRE_NON_NULL(output);
-    M_REQUIRE_NON_NULL_IMAGE_LINE(iml1);
-    M_REQUIRE_NON_NULL_IMAGE_LINE(iml2);
+    M_REQUIRE_NON_NULL(p_opacity);
+    M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(*output, iml1);
     M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(iml1, iml2);
+    M_REQUIRE(p_opacity->size == iml1.opacity->size, ERR_BAD_PARAMETER, "%s", "Sizes do not match");
 
-    bit_vector_t* notopacity = bit_vector_not(bit_vector_cpy(p_opacity));
-
-    bit_vector_t* m_above_and_opacity    = bit_vector_and(bit_vector_cpy(iml2.msb), p_opacity );
-    bit_vector_t* l_above_and_opacity    = bit_vector_and(bit_vector_cpy(iml2.lsb), p_opacity );
-    bit_vector_t* m_below_and_notopacity = bit_vector_and(bit_vector_cpy(iml1.msb), notopacity);
-    bit_vector_t* l_below_and_notopacity = bit_vector_and(bit_vector_cpy(iml1.lsb), notopacity);
-
-    if (notopacity == NULL ||
-        m_above_and_opacity == NULL || m_below_and_notopacity == NULL ||
-        l_above_and_opacity == NULL || l_below_and_notopacity == NULL) {
-        bit_vector_free(&notopacity);
-        bit_vector_free(&m_above_and_opacity);
-        bit_vector_free(&m_below_and_notopacity);
-        bit_vector_free(&l_above_and_opacity);
-        bit_vector_free(&l_below_and_notopacity);
-        return ERR_MEM;
-    }
+    M_REQUIRE_BIT_VECTOR(bit_vector_blend(output->msb, iml1.msb, iml2.msb, p_opacity));
+    M_REQUIRE_BIT_VECTOR(bit_vector_blend(output->lsb, iml1.lsb, iml2.lsb, p_opacity));
 
-    output->msb     = bit_vector_or(m_below_and_notopacity, m_above_and_opacity);
-    output->lsb     = bit_vector_or(l_below_and_notopacity, l_above_and_opacity);
-    output->opacity = bit_vector_or(bit_vector_cpy(iml1.opacity), p_opacity          );
-
-    bit_vector_free(&notopacity);
-    bit_vector_free(&m_above_and_opacity);
-    bit_vector_free(&l_above_and_opacity);
+    // output opacity is iml1.opacity | p_opacity, p_opacity being possibly output->opacity itself
+    if (output->opacity == p_opacity) {
+        M_REQUIRE_BIT_VECTOR(bit_vector_or(output->opacity, iml1.opacity));
+    } else {
+        M_REQUIRE_BIT_VECTOR(bit_vector_or(bit_vector_cpy_into(output->opacity, iml1.opacity), p_opacity));
+    }
 
     return ERR_NONE;
 }
 
 // ======================================================================
-int image_line_below(image_line_t* output, image_line_t iml1, image_line_t iml2)
+int image_line_below_into(image_line_t* output, image_line_t iml1, image_line_t iml2)
 {
-    M_REQUIRE_NON_NULL(output);
-    M_REQUIRE_NON_NULL_IMAGE_LINE(iml1);
     M_REQUIRE_NON_NULL_IMAGE_LINE(iml2);
-    M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(iml1, iml2);
 
-    return image_line_below_with_opacity(output, iml1, iml2, iml2.opacity);
+    return image_line_below_with_opacity_into(output, iml1, iml2, iml2.opacity);
 }
 
 // ======================================================================
-int image_line_join(image_line_t* output, image_line_t iml1, image_line_t iml2, int64_t start)
+int image_line_join_into(image_line_t* output, image_line_t iml1, image_line_t iml2, int64_t start)
 {
     M_REQUIRE_NON_NULL(output);
-    M_REQUIRE_NON_NULL_IMAGE_LINE(iml1);
-    M_REQUIRE_NON_NULL_IMAGE_LINE(iml2);
+    M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(*output, iml1);
     M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(iml1, iml2);
     M_REQUIRE(start >= 0, ERR_BAD_PARAMETER, "Incorrect start (%ld < 0)", start);
     M_REQUIRE(start < (int64_t)iml1.msb->size, ERR_BAD_PARAMETER,
               "Incorrect start (%ld < %lu)", start, iml1.msb->size);
-    M_REQUIRE(start < (int64_t)iml1.lsb->size, ERR_BAD_PARAMETER,
-              "Incorrect start (%ld < %lu)", start, iml1.lsb->size);
-    M_REQUIRE(start < (int64_t)iml1.opacity->size, ERR_BAD_PARAMETER,
-              "Incorrect start (%ld < %lu)", start, iml1.opacity->size);
 
-    const int64_t size = (int64_t)iml1.lsb->size;
-
-    if (start % size == 0) {
 #define do(I, X) \
-        I->X = bit_vector_cpy(iml2.X)
+    M_REQUIRE_BIT_VECTOR(bit_vector_join_into(I->X, iml1.X, iml2.X, start))
 
-        do_image_line(output);
-#undef do
-    } else {
-#define do(I, X) \
-        I->X = bit_vector_join(iml1.X, iml2.X, start)
-
-        do_image_line(output);
+    do_image_line(output);
 #undef do
-    }
 
-    return valid(output);
+    return ERR_NONE;
 }
 
 // ======================================================================
@@ -290,26 +342,45 @@ void image_line_free(image_line_t* piml)
 }
 
 // ======================================================================
+/*
+ * An image is a single block: the lines, then their bit vectors (msb, lsb,
+ * opacity for each line), then the words of all these bit vectors, line after line.
+ * The words are kept together, even for lines short enough for the inline content
+ * of the bit vectors (left unused), so that image_copy() is a single memcpy.
+ */
+#define image_vectors(pim) ((bit_vector_t*) ((pim)->content + (pim)->height))
+#define image_words(pim) ((uint32_t*) (image_vectors(pim) + 3 * (pim)->height))
+#define image_nb_words(pim) ((pim)->height * 3 * (pim)->content[0].msb->nb_fields)
+
 int image_create(image_t* pim, size_t width, size_t height)
 {
     M_REQUIRE_NON_NULL(pim);
     M_REQUIRE(width > 0, ERR_BAD_PARAMETER, "%s", "Parameter width is zero.");
     M_REQUIRE(height > 0, ERR_BAD_PARAMETER, "%s", "Parameter height is zero.");
 
-    pim->content = calloc(height, sizeof(image_line_t));
+    const size_t nb_fields = size_to_content_size(width);
+    const size_t nb_vectors = 3 * height;
+
+    pim->content = calloc(1, height * sizeof(image_line_t) + nb_vectors * sizeof(bit_vector_t)
+                          + nb_vectors * nb_fields * sizeof(uint32_t));
     if (pim->content == NULL) return ERR_MEM;
 
     pim->height = height;
 
-    int error = ERR_NONE;
-    for (size_t i = 0; i < height && error == ERR_NONE; ++i) {
-        error = image_line_create(pim->content + i, width);
-    }
+    bit_vector_t* vectors = image_vectors(pim);
+    uint32_t* words = image_words(pim);
 
-    if (error != ERR_NONE) {
-        image_free(pim);
-        return error;
+#define do(I, X) \
+    I->X = vectors++; \
+    I->X->size = width; \
+    I->X->nb_fields = nb_fields; \
+    I->X->content = words; \
+    words += nb_fields
+
+    for (image_line_t* line = pim->content; line < pim->content + height; ++line) {
+        do_image_line(line);
     }
+#undef do
 
     return ERR_NONE;
 }
@@ -349,18 +420,26 @@ int image_get_pixel(uint8_t* output, image_t* pim, size_t x, size_t y)
 // ======================================================================
 int image_own_line_content(image_t* pim, size_t y, image_line_t line)
 {
-    M_REQUIRE_NON_NULL(pim);
-    M_REQUIRE(y < pim->height, ERR_BAD_PARAMETER, "Invalid Y parameter (%lu < %lu)", y, pim->height);
-    M_REQUIRE_NON_NULL_IMAGE_LINE(pim->content[y]);
-    M_REQUIRE_NON_NULL_IMAGE_LINE(line);
-    M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(pim->content[y], line);
+    M_REQUIRE_NO_ERR(image_set_line(pim, y, line));
 
-#define do(I, X) \
-    bit_vector_free(&(I->content[y].X)); \
-    I->content[y].X = line.X
+    image_line_free(&line);
+    return ERR_NONE;
+}
+
+// ======================================================================
+int image_copy(image_t* dst, const image_t* src)
+{
+    M_REQUIRE_NON_NULL(dst);
+    M_REQUIRE_NON_NULL(src);
+    M_REQUIRE_NON_NULL(dst->content);
+    M_REQUIRE_NON_NULL(src->content);
+    M_REQUIRE(dst->height == src->height, ERR_BAD_PARAMETER, "Heights do not match (%lu != %lu)", dst->height, src->height);
+    M_REQUIRE_MATCHING_IMAGE_LINE_SIZE(dst->content[0], src->content[0]);
+
+    if (dst != src) {
+        memcpy(image_words(dst), image_words(src), image_nb_words(src) * sizeof(uint32_t));
+    }
 
-    do_image_line(pim);
-#undef do
     return ERR_NONE;
 }
 
@@ -369,10 +448,6 @@ void image_free(image_t* pim)
 {
     if (pim == NULL) return;
 
-    for (size_t i = 0; i < pim->height; ++i) {
-        image_line_free(pim->content + i);
-    }
-
     pim->height = 0;
     free(pim->content);
     pim->content = NULL;
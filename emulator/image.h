@@ -43,7 +43,7 @@ typedef struct image_line_ image_line_t;
  */
 struct image_ {
     size_t height;
-    image_line_t* content;
+    image_line_t* content; // single block holding the lines, their bit vectors and their words (see image_create())
 };
 typedef struct image_ image_t;
 
@@ -130,6 +130,84 @@ int image_line_below(image_line_t* output, image_line_t iml1, image_line_t iml2)
  */
 int image_line_join(image_line_t* output, image_line_t iml1, image_line_t iml2, int64_t start);
 
+//=========================================================================
+/*
+ * Allocation-free variants: the output line must already be allocated
+ * (see image_line_create()) with the size of the result; nothing is allocated.
+ */
+
+//=========================================================================
+/**
+ * @brief Shift image line into an existing one
+ * @param output pointer to image line to write to (same size as iml, distinct from it)
+ * @param iml image line to shift
+ * @param shift shift amount
+ * @return Error code
+ */
+int image_line_shift_into(image_line_t* output, image_line_t iml, int64_t shift);
+
+//=========================================================================
+/**
+ * @brief Extract image line (wrapping) into an existing one
+ * @param output pointer to image line to write to (its size is the size extracted, distinct from iml)
+ * @param iml image line to extract
+ * @param index index from which to extract
+ * @return Error code
+ */
+int image_line_extract_wrap_ext_into(image_line_t* output, image_line_t iml, int64_t index);
+
+//=========================================================================
+/**
+ * @brief Apply Palette to image line, into an existing one, in a single pass over its words
+ *        (applying DEFAULT_PALETTE in place leaves the line untouched)
+ * @param output pointer to image line to write to (same size as iml, may be iml itself)
+ * @param iml image line to use palette on
+ * @param map palette to use
+ * @return Error code
+ */
+int image_line_map_colors_into(image_line_t* output, image_line_t iml, palette_t map);
+
+//=========================================================================
+/**
+ * @brief Combine two image lines using opacity, into an existing one
+ * @param output pointer to image line to write to (same size, may be iml1 or iml2)
+ * @param iml1 image line to combine
+ * @param iml2 image line to combine
+ * @param p_opacity bit vector pointer to use for opacity
+ * @return Error code
+ */
+int image_line_below_with_opacity_into(image_line_t* output, image_line_t iml1, image_line_t iml2, const bit_vector_t* p_opacity);
+
+//=========================================================================
+/**
+ * @brief Combine two image lines (using iml2 opacity), into an existing one
+ * @param output pointer to image line to write to (same size, may be iml1 or iml2)
+ * @param iml1 image line to combine
+ * @param iml2 image line to combine
+ * @return Error code
+ */
+int image_line_below_into(image_line_t* output, image_line_t iml1, image_line_t iml2);
+
+//=========================================================================
+/**
+ * @brief Join two image lines into an existing one
+ * @param output pointer to image line to write to (same size, may be iml1 or iml2)
+ * @param iml1 image line to join (values from 0 to start)
+ * @param iml2 image line to join (values from start to end)
+ * @param start index from which to use iml2 values
+ * @return Error code
+ */
+int image_line_join_into(image_line_t* output, image_line_t iml1, image_line_t iml2, int64_t start);
+
+//=========================================================================
+/**
+ * @brief Copy an image into another one of the same size (a single memcpy)
+ * @param dst pointer to (created) image to write to
+ * @param src pointer to image to copy
+ * @return Error code
+ */
+int image_copy(image_t* dst, const image_t* src);
+
 //=========================================================================
 /**
  * @brief Free image line
@@ -139,7 +217,8 @@ void image_line_free(image_line_t* piml);
 
 //=========================================================================
 /**
- * @brief Creates an image of given width and height
+ * @brief Creates an image of given width and height, in a single allocation
+ *        (its lines must thus never be freed with image_line_free())
  * @param pim pointer to image
  * @param width image width
  * @param height image height
@@ -170,10 +249,11 @@ int image_get_pixel(uint8_t* output, image_t* pim, size_t x, size_t y);
 
 //=========================================================================
 /**
- * @brief Set line content of image (using provided bit vectors pointers)
+ * @brief Set line content of image, taking ownership of the line
+ *        (its content is copied, then it is freed)
  * @param pim pointer to image
  * @param y line index to set
- * @param line line to use bit vectors from
+ * @param line line to take the content of
  * @return Error code
  */
 int image_own_line_content(image_t* pim, size_t y, image_line_t line);
@@ -0,0 +1,1385 @@
+/**
+ * @file lcdc.c
+ * @brief Game Boy LCD controller simulation: mode timing, STAT/LYC interrupts,
+ *        OAM DMA and scanline rendering (background, window and sprites)
+ *
+ * @author E. Wengle, E. Garandel, EPFL
+ * @date 2020
+ */
+
+#include <stdint.h>
+#include <stdlib.h> // calloc, free
+#include <string.h> // memset, memcpy, memcmp
+#include <inttypes.h> // PRIu64
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "lcdc.h"
+#include "gameboy.h"
+#include "myMacros.h" // DEFAULT_READ_VALUE
+#include "util.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// value of next_cycle while the LCD is off
+#define LCDC_NO_CYCLE ((uint64_t) -1)
+
+// LCDC modes, as found in STAT
+#define MODE_HBLANK 0
+#define MODE_VBLANK 1
+#define MODE_OAM    2
+#define MODE_VRAM   3
+
+// STAT bit enabling the LCD_STAT interrupt on entering the given mode (0 to 2)
+#define STAT_REG_INT_MODE_BIT(mode) ((mode) + 3)
+
+// number of tile bytes per pixel line
+#define TILE_LINE_BYTES 2
+#define TILES_PER_WORD  (IMAGE_LINE_WORD_BITS / TILE_HEIGHT)
+
+// the tile index is signed when the tiles are taken from TILE_SRC_ADDR_HIGH
+#define TILE_SIGNED_INDEX 0x80
+
+// sprites (OAM entries)
+#define OAM_NB_SPRITES       40
+#define OAM_SPRITE_SIZE      4
+#define SPRITE_Y_OFFSET      16
+#define SPRITE_X_OFFSET      8
+#define SPRITE_HEIGHT(lcdc)  (((lcdc) & LCDC_REG_OBJ_SIZE_MASK) ? 2 * TILE_HEIGHT : TILE_HEIGHT)
+
+// offsets of the fields of an OAM entry
+#define SPRITE_Y    0
+#define SPRITE_X    1
+#define SPRITE_TILE 2
+#define SPRITE_ATTR 3
+
+#define SPRITE_ATTR_BEHIND_BG 0x80
+#define SPRITE_ATTR_Y_FLIP    0x40
+#define SPRITE_ATTR_X_FLIP    0x20
+#define SPRITE_ATTR_PALETTE   0x10
+
+// address of a field of the given sprite in OAM
+#define sprite_addr(index, field) \
+    ((addr_t) (GRAPH_RAM_START + (index) * OAM_SPRITE_SIZE + (field)))
+
+/**
+ * @brief Reads a byte on the bus, without going through the IO sync hook of the cpu
+ *        (the LCDC is the one being synchronized)
+ * @param lcd LCD controler reading
+ * @param addr address to read
+ * @return value read
+ */
+static inline data_t lcdc_read(const lcdc_t* lcd, addr_t addr)
+{
+    const data_t* const p = (*(lcd->cpu->bus))[addr];
+    return p == NULL ? DEFAULT_READ_VALUE : *p;
+}
+
+/**
+ * @brief Writes a byte on the bus, see lcdc_read()
+ * @param lcd LCD controler writing
+ * @param addr address to write to
+ * @param data value to write
+ */
+static inline void lcdc_write(const lcdc_t* lcd, addr_t addr, data_t data)
+{
+    data_t* const p = (*(lcd->cpu->bus))[addr];
+    if(p != NULL) *p = data;
+}
+
+/**
+ * @brief Mirrors a byte (bit 7 of tile data is the leftmost pixel, bit 0 of image lines is)
+ * @param b byte to mirror
+ * @return mirrored byte
+ */
+static inline uint8_t reverse8(uint8_t b)
+{
+    b = (uint8_t) (((b & 0xF0) >> 4) | ((b & 0x0F) << 4));
+    b = (uint8_t) (((b & 0xCC) >> 2) | ((b & 0x33) << 2));
+    return (uint8_t) (((b & 0xAA) >> 1) | ((b & 0x55) << 1));
+}
+
+/**
+ * @brief Sets the mode in STAT and raises LCD_STAT if enabled for this mode
+ * @param lcd LCD controler
+ * @param mode new mode
+ */
+static void lcdc_set_mode(lcdc_t* lcd, uint8_t mode)
+{
+    const data_t stat = (data_t) ((lcdc_read(lcd, REG_STAT) & ~STAT_REG_MODE_MASK) | (mode & STAT_REG_MODE_MASK));
+    lcdc_write(lcd, REG_STAT, stat);
+
+    if(mode <= MODE_OAM && bit_get(stat, STAT_REG_INT_MODE_BIT(mode))){
+        cpu_request_interrupt(lcd->cpu, LCD_STAT);
+    }
+}
+
+/**
+ * @brief Updates the LYC=LY flag of STAT and raises LCD_STAT if they match (and it is enabled)
+ * @param lcd LCD controler
+ */
+static void lcdc_update_lyc(lcdc_t* lcd)
+{
+    const bit_t equal = lcdc_read(lcd, REG_LY) == lcdc_read(lcd, REG_LYC);
+    data_t stat = lcdc_read(lcd, REG_STAT);
+    bit_edit(&stat, STAT_REG_LYC_EQ_LY_BIT, equal);
+    lcdc_write(lcd, REG_STAT, stat);
+
+    if(equal && bit_get(stat, STAT_REG_INT_LYC_BIT)){
+        cpu_request_interrupt(lcd->cpu, LCD_STAT);
+    }
+}
+
+/**
+ * @brief Scratch lines of a worker rendering lines of the display
+ */
+typedef struct {
+    lcdc_pool_t* pool;
+    pthread_t thread;
+    lcdc_lines_t lines;
+} lcdc_worker_t;
+
+/**
+ * @brief Worker threads rendering the pending lines of a frame in parallel,
+ *        from the registers captured when each line started (see lcdc_set_render_threads())
+ */
+struct lcdc_pool_ {
+    lcdc_t* lcd;
+    lcdc_worker_t* workers; // besides the thread simulating the Game Boy, which renders too
+    size_t nb_workers;
+    data_t mirror[0x10000]; // VRAM and OAM as the pending lines see them, indexed by address
+
+    uint8_t first_pending;  // lines first_pending to end_pending (excluded) are still to be rendered
+    uint8_t end_pending;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;   // a new batch of lines is to be rendered
+    pthread_cond_t done;    // all the workers are done with the batch
+    uint64_t batch;         // number of the current batch
+    uint8_t next;           // next line of the batch to render
+    uint8_t end;            // end of the batch (excluded)
+    size_t busy;            // number of workers still on the batch
+    int error;              // first error met on the batch
+    bit_t quit;
+};
+
+// writes to VRAM and OAM a job of the pipeline holds, at most: a full job is handed over at once
+#define PIPELINE_JOURNAL_SIZE 0x2000
+
+// jobs of the pipeline: one filled while the other is replayed
+#define PIPELINE_NB_JOBS 2
+
+/**
+ * @brief Write to VRAM or OAM journaled for the rendering pipeline
+ */
+typedef struct {
+    addr_t addr;
+    data_t value;
+    uint8_t line; // the lines before this one are rendered before the write
+} lcdc_journal_entry_t;
+
+/**
+ * @brief Lines captured and writes journaled by the thread simulating the Game Boy,
+ *        to be replayed by the rendering thread of the pipeline
+ */
+typedef struct {
+    lcdc_line_state_t states[LCD_HEIGHT];
+    uint8_t first_line; // lines first_line to end_line (excluded) are to be rendered
+    uint8_t end_line;
+    lcdc_journal_entry_t journal[PIPELINE_JOURNAL_SIZE];
+    size_t nb_writes;
+    bit_t frame_done;   // whether the frame is complete after these lines (VBlank)
+} lcdc_job_t;
+
+/**
+ * @brief Thread rendering the display of a frame while the next one is emulated
+ *        (see lcdc_set_pipeline())
+ */
+struct lcdc_pipeline_ {
+    lcdc_t* shadow; // LCD controler of the rendering thread: its own copy of VRAM and OAM, caches and framebuffer
+    pthread_t thread;
+    lcdc_job_t jobs[PIPELINE_NB_JOBS]; // job number n is in jobs[n % PIPELINE_NB_JOBS]
+
+    pthread_mutex_t mutex;
+    pthread_cond_t submitted_cond; // a new job is to be replayed
+    pthread_cond_t done_cond;      // a job has been replayed
+    uint64_t submitted;            // number of jobs handed over to the rendering thread
+    uint64_t done;                 // number of jobs replayed
+    int error;                     // first error met by the rendering thread
+    bit_t quit;
+
+    // frames completed: lock-free queue, from the rendering thread to a single consumer
+    lcdc_framebuffer_t frames[LCDC_FRAME_QUEUE_SIZE];
+    bit_t dirty[LCDC_FRAME_QUEUE_SIZE][LCD_HEIGHT]; // lines changed since the frame before
+    atomic_size_t head; // number of frames taken
+    atomic_size_t tail; // number of frames queued
+};
+
+/**
+ * @brief Reads a byte of VRAM or OAM, as seen by the lines being rendered
+ * @param lcd LCD controler reading
+ * @param addr address to read
+ * @return value read
+ */
+static inline data_t lcdc_video_read(const lcdc_t* lcd, addr_t addr)
+{
+    return lcd->pool == NULL ? lcdc_read(lcd, addr) : lcd->pool->mirror[addr];
+}
+
+/**
+ * @brief Decodes a tile of VRAM into the tile cache
+ * @param lcd LCD controler
+ * @param tile index of the tile in VRAM (less than TILE_NB)
+ */
+static void lcdc_decode_tile(lcdc_t* lcd, size_t tile)
+{
+    lcdc_tile_cache_t* const c = &(lcd->tile_cache);
+    const addr_t addr = (addr_t) (TILE_SRC_ADDR_LOW + tile * TILE_SIZE);
+    for(size_t r = 0; r < TILE_HEIGHT; ++r){
+        c->lsb[tile][r] = reverse8(lcdc_video_read(lcd, (addr_t) (addr + r * TILE_LINE_BYTES)));
+        c->msb[tile][r] = reverse8(lcdc_video_read(lcd, (addr_t) (addr + r * TILE_LINE_BYTES + 1)));
+    }
+    c->dirty[tile] = 0;
+}
+
+/**
+ * @brief Gives a pixel line of a tile, decoding the tile first if it was written to
+ * @param lcd LCD controler
+ * @param tile index of the tile in VRAM (less than TILE_NB)
+ * @param row pixel line in the tile
+ * @param lsb (modified) lsb of the pixels, in image line order
+ * @param msb (modified) msb of the pixels, in image line order
+ */
+static inline void lcdc_tile_row(lcdc_t* lcd, size_t tile, size_t row, data_t* lsb, data_t* msb)
+{
+    const lcdc_tile_cache_t* const c = &(lcd->tile_cache);
+    if(c->dirty[tile]){
+        lcdc_decode_tile(lcd, tile);
+    }
+    *lsb = c->lsb[tile][row];
+    *msb = c->msb[tile][row];
+}
+
+/**
+ * @brief Builds a line of tiles from a tile map
+ * @param output (allocated) line, the size of which gives the number of tiles to read
+ *        (multiple of TILES_PER_WORD)
+ * @param lcd LCD controler
+ * @param lcdc value of the LCDC register
+ * @param high_map whether to use the tile map at TILE_ADDR_BASE_HIGH
+ * @param y index of the pixel line in the tile map
+ * @return error code
+ */
+static int lcdc_tile_line(image_line_t* output, lcdc_t* lcd, data_t lcdc, bit_t high_map, uint8_t y)
+{
+    const addr_t map = (addr_t) ((high_map ? TILE_ADDR_BASE_HIGH : TILE_ADDR_BASE_LOW) + (y / TILE_HEIGHT) * TILE_LINE_SIZE);
+    const bit_t unsigned_index = (lcdc & LCDC_REG_TILE_SOURCE_MASK) != 0;
+    const size_t first = ((unsigned_index ? TILE_SRC_ADDR_LOW : TILE_SRC_ADDR_HIGH) - TILE_SRC_ADDR_LOW) / TILE_SIZE;
+    const size_t row = y % TILE_HEIGHT;
+    const size_t nb_tiles = output->msb->size / TILE_HEIGHT;
+
+    for(size_t w = 0; w < nb_tiles / TILES_PER_WORD; ++w){
+        uint32_t msb = 0;
+        uint32_t lsb = 0;
+        for(size_t i = 0; i < TILES_PER_WORD; ++i){
+            uint8_t index = lcdc_video_read(lcd, (addr_t) (map + w * TILES_PER_WORD + i));
+            if(!unsigned_index) index ^= TILE_SIGNED_INDEX;
+
+            data_t tile_lsb = 0, tile_msb = 0;
+            lcdc_tile_row(lcd, first + index, row, &tile_lsb, &tile_msb);
+            lsb |= (uint32_t) tile_lsb << (i * TILE_HEIGHT);
+            msb |= (uint32_t) tile_msb << (i * TILE_HEIGHT);
+        }
+        M_REQUIRE_NO_ERR(image_line_set_word(output, w, msb, lsb));
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Makes a line fully transparent (color 0)
+ * @param line (allocated) line to clear
+ * @return error code
+ */
+static int lcdc_clear_line(image_line_t* line)
+{
+    for(size_t w = 0; w < line->msb->nb_fields; ++w){
+        M_REQUIRE_NO_ERR(image_line_set_word(line, w, 0, 0));
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Captures the registers a line is to be rendered with, when it starts (mode 3),
+ *        and whether it shows the window
+ * @param lcd LCD controler, the window line counter of which is updated
+ * @param ly line starting
+ */
+static void lcdc_capture_line(lcdc_t* lcd, uint8_t ly)
+{
+    lcdc_line_state_t* const s = &(lcd->line_states[ly]);
+    s->lcdc = lcdc_read(lcd, REG_LCDC);
+    s->scy  = lcdc_read(lcd, REG_SCY);
+    s->scx  = lcdc_read(lcd, REG_SCX);
+    s->bgp  = lcdc_read(lcd, REG_BGP);
+    s->obp0 = lcdc_read(lcd, REG_OBP0);
+    s->obp1 = lcdc_read(lcd, REG_OBP1);
+    s->wx   = lcdc_read(lcd, REG_WX);
+
+    s->window = (s->lcdc & LCDC_REG_BG_MASK) && (s->lcdc & LCDC_REG_WIN_MASK) &&
+                s->wx >= WINDOW_OFFSET_X && s->wx - WINDOW_OFFSET_X < LCD_WIDTH && ly >= lcdc_read(lcd, REG_WY);
+    s->window_y = lcd->window_y;
+    if(s->window){
+        ++lcd->window_y;
+    }
+}
+
+/**
+ * @brief Renders the background of a line (into l->line), blank if disabled
+ * @param l scratch lines
+ * @param lcd LCD controler
+ * @param s registers of the line
+ * @param ly line to render
+ * @return error code
+ */
+static int lcdc_render_background(lcdc_lines_t* l, lcdc_t* lcd, const lcdc_line_state_t* s, uint8_t ly)
+{
+    if(!(s->lcdc & LCDC_REG_BG_MASK)){
+        return lcdc_clear_line(&(l->line));
+    }
+
+    M_REQUIRE_NO_ERR(lcdc_tile_line(&(l->tiles), lcd, s->lcdc, (s->lcdc & LCDC_REG_BG_AREA_MASK) != 0,
+                                    (uint8_t) (s->scy + ly)));
+    M_REQUIRE_NO_ERR(image_line_extract_wrap_ext_into(&(l->line), l->tiles, s->scx));
+    return image_line_map_colors_into(&(l->line), l->line, s->bgp);
+}
+
+/**
+ * @brief Draws the window (if shown on the line) over the background line
+ * @param l scratch lines
+ * @param lcd LCD controler
+ * @param s registers of the line
+ * @return error code
+ */
+static int lcdc_render_window(lcdc_lines_t* l, lcdc_t* lcd, const lcdc_line_state_t* s)
+{
+    if(!s->window){
+        return ERR_NONE;
+    }
+    const int64_t x = s->wx - WINDOW_OFFSET_X;
+
+    M_REQUIRE_NO_ERR(lcdc_tile_line(&(l->window), lcd, s->lcdc, (s->lcdc & LCDC_REG_WIN_AREA_MASK) != 0, s->window_y));
+    M_REQUIRE_NO_ERR(image_line_map_colors_into(&(l->window), l->window, s->bgp));
+    M_REQUIRE_NO_ERR(image_line_shift_into(&(l->tmp), l->window, x));
+    return image_line_join_into(&(l->line), l->line, l->tmp, x);
+}
+
+/**
+ * @brief Priority key of a sprite: sprites with smaller keys are drawn above the others
+ */
+#define sprite_key(lcd, index) merge8(index, lcdc_video_read(lcd, sprite_addr(index, SPRITE_X)))
+
+/**
+ * @brief Builds the sprite list of every line: at most LINE_MAX_SPRITES in OAM order,
+ *        sorted by decreasing priority (increasing x, then OAM index)
+ * @param lcd LCD controler, the sprite cache of which is rebuilt
+ * @param lcdc value of the LCDC register
+ */
+static void lcdc_build_sprite_lists(lcdc_t* lcd, data_t lcdc)
+{
+    lcdc_sprite_cache_t* const c = &(lcd->sprite_cache);
+    memset(c->nb_sprites, 0, sizeof(c->nb_sprites));
+
+    const int height = SPRITE_HEIGHT(lcdc);
+    for(uint8_t i = 0; i < OAM_NB_SPRITES; ++i){
+        const int y = lcdc_video_read(lcd, sprite_addr(i, SPRITE_Y)) - SPRITE_Y_OFFSET;
+        const uint16_t key = sprite_key(lcd, i);
+
+        for(int ly = y < 0 ? 0 : y; ly < y + height && ly < LCD_HEIGHT; ++ly){
+            uint8_t* const sprites = c->sprites[ly];
+            size_t k = c->nb_sprites[ly];
+            if(k == LINE_MAX_SPRITES) continue;
+
+            // insertion sort on (x, index)
+            ++c->nb_sprites[ly];
+            for(; k > 0 && sprite_key(lcd, sprites[k - 1]) > key; --k){
+                sprites[k] = sprites[k - 1];
+            }
+            sprites[k] = i;
+        }
+    }
+
+    c->obj_size = lcdc & LCDC_REG_OBJ_SIZE_MASK;
+    c->dirty = 0;
+}
+
+/**
+ * @brief Brings the sprite lists up to date for lines drawn with the given LCDC register
+ * @param lcd LCD controler
+ * @param lcdc value of the LCDC register
+ */
+static inline void lcdc_update_sprite_lists(lcdc_t* lcd, data_t lcdc)
+{
+    const lcdc_sprite_cache_t* const c = &(lcd->sprite_cache);
+    if(c->dirty || c->obj_size != (lcdc & LCDC_REG_OBJ_SIZE_MASK)){
+        lcdc_build_sprite_lists(lcd, lcdc);
+    }
+}
+
+/**
+ * @brief Renders the given sprites on a line, higher priority sprites above the others
+ * @param output (allocated) sprites line
+ * @param l scratch lines
+ * @param lcd LCD controler
+ * @param s registers of the line
+ * @param ly line to render
+ * @param sprites OAM indexes of the sprites, by decreasing priority
+ * @param nb_sprites number of sprites
+ * @param foreground whether to render only the sprites drawn above the background
+ * @return error code
+ */
+static int lcdc_render_sprites(image_line_t* output, lcdc_lines_t* l, lcdc_t* lcd, const lcdc_line_state_t* s,
+                               uint8_t ly, const uint8_t* sprites, size_t nb_sprites, bit_t foreground)
+{
+    M_REQUIRE_NO_ERR(lcdc_clear_line(output));
+
+    for(size_t k = 0; k < nb_sprites; ++k){
+        const uint8_t i = sprites[k];
+        const data_t attr = lcdc_video_read(lcd, sprite_addr(i, SPRITE_ATTR));
+        if(foreground && (attr & SPRITE_ATTR_BEHIND_BG)) continue;
+
+        const int height = SPRITE_HEIGHT(s->lcdc);
+        int row = ly - (lcdc_video_read(lcd, sprite_addr(i, SPRITE_Y)) - SPRITE_Y_OFFSET);
+        if(attr & SPRITE_ATTR_Y_FLIP) row = height - 1 - row;
+
+        data_t tile = lcdc_video_read(lcd, sprite_addr(i, SPRITE_TILE));
+        if(height > TILE_HEIGHT) tile &= 0xFE; // 8x16 sprites use an even/odd pair of tiles
+
+        data_t lsb = 0, msb = 0;
+        lcdc_tile_row(lcd, (size_t) (tile + row / TILE_HEIGHT), (size_t) (row % TILE_HEIGHT), &lsb, &msb);
+        if(attr & SPRITE_ATTR_X_FLIP){
+            lsb = reverse8(lsb);
+            msb = reverse8(msb);
+        }
+
+        // only the first word of l->sprite is ever set, the others stay transparent
+        M_REQUIRE_NO_ERR(image_line_set_word(&(l->sprite), 0, msb, lsb));
+        M_REQUIRE_NO_ERR(image_line_shift_into(&(l->tmp), l->sprite, lcdc_video_read(lcd, sprite_addr(i, SPRITE_X)) - SPRITE_X_OFFSET));
+        M_REQUIRE_NO_ERR(image_line_map_colors_into(&(l->tmp), l->tmp, (attr & SPRITE_ATTR_PALETTE) ? s->obp1 : s->obp0));
+
+        // sprites already drawn have a higher priority
+        M_REQUIRE_NO_ERR(image_line_below_into(output, l->tmp, *output));
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Draws the sprites (if enabled) over the background and window line
+ * @param l scratch lines
+ * @param lcd LCD controler
+ * @param s registers of the line
+ * @param ly line to render
+ * @return error code
+ */
+static int lcdc_render_objects(lcdc_lines_t* l, lcdc_t* lcd, const lcdc_line_state_t* s, uint8_t ly)
+{
+    if(!(s->lcdc & LCDC_REG_OBJ_MASK)){
+        return ERR_NONE;
+    }
+
+    lcdc_update_sprite_lists(lcd, s->lcdc);
+    const uint8_t* const sprites = lcd->sprite_cache.sprites[ly];
+    const size_t n = lcd->sprite_cache.nb_sprites[ly];
+    if(n == 0){
+        return ERR_NONE;
+    }
+
+    // all the sprites show where the background is transparent (color 0) ...
+    M_REQUIRE_NO_ERR(lcdc_render_sprites(&(l->back), l, lcd, s, ly, sprites, n, 0));
+
+    M_REQUIRE(bit_vector_or(bit_vector_not(bit_vector_cpy_into(l->opacity, l->back.opacity)), l->line.opacity) != NULL,
+              ERR_BAD_PARAMETER, "%s", "cannot compute the sprites opacity");
+    M_REQUIRE_NO_ERR(image_line_below_with_opacity_into(&(l->line), l->back, l->line, l->opacity));
+
+    // ... and the foreground ones also show over it
+    M_REQUIRE_NO_ERR(lcdc_render_sprites(&(l->front), l, lcd, s, ly, sprites, n, 1));
+    return image_line_below_into(&(l->line), l->line, l->front);
+}
+
+/**
+ * @brief Unpacks a rendered line into the framebuffer, marking it dirty if it changed
+ * @param lcd LCD controler
+ * @param l scratch lines, holding the rendered line
+ * @param ly line of the framebuffer to write
+ */
+static void lcdc_store_line(lcdc_t* lcd, const lcdc_lines_t* l, uint8_t ly)
+{
+    const image_line_t line = l->line;
+    uint8_t pixels[LCD_WIDTH];
+    for(size_t w = 0; w < LCD_WIDTH / IMAGE_LINE_WORD_BITS; ++w){
+        const uint32_t msb = line.msb->content[w];
+        const uint32_t lsb = line.lsb->content[w];
+        for(size_t i = 0; i < IMAGE_LINE_WORD_BITS; ++i){
+            pixels[w * IMAGE_LINE_WORD_BITS + i] = (uint8_t) ((((msb >> i) & 1) << 1) | ((lsb >> i) & 1));
+        }
+    }
+
+    if(memcmp(lcd->framebuffer[ly], pixels, LCD_WIDTH) != 0){
+        memcpy(lcd->framebuffer[ly], pixels, LCD_WIDTH);
+        lcd->dirty_lines[ly] = 1;
+    }
+}
+
+/**
+ * @brief Renders a full line of the display, with the registers captured when it started,
+ *        without any allocation
+ * @param lcd LCD controler
+ * @param l scratch lines to render with
+ * @param ly line to render
+ * @return error code
+ */
+static int lcdc_render_line(lcdc_t* lcd, lcdc_lines_t* l, uint8_t ly)
+{
+    const lcdc_line_state_t* const s = &(lcd->line_states[ly]);
+
+    M_REQUIRE_NO_ERR(lcdc_render_background(l, lcd, s, ly));
+    M_REQUIRE_NO_ERR(lcdc_render_window(l, lcd, s));
+    M_REQUIRE_NO_ERR(lcdc_render_objects(l, lcd, s, ly));
+    lcdc_store_line(lcd, l, ly);
+    return ERR_NONE;
+}
+
+/**
+ * @brief Renders the lines of the current batch not taken yet by another thread
+ *        (to be called with the mutex of the pool held)
+ * @param pool pool of workers
+ * @param l scratch lines of the calling thread
+ */
+static void lcdc_render_batch(lcdc_pool_t* pool, lcdc_lines_t* l)
+{
+    while(pool->next < pool->end){
+        const uint8_t ly = pool->next++;
+        pthread_mutex_unlock(&(pool->mutex));
+        const int err = lcdc_render_line(pool->lcd, l, ly);
+        pthread_mutex_lock(&(pool->mutex));
+        if(err != ERR_NONE && pool->error == ERR_NONE){
+            pool->error = err;
+        }
+    }
+}
+
+/**
+ * @brief Body of the worker threads: renders the batches of lines, until asked to quit
+ * @param arg worker (lcdc_worker_t)
+ * @return NULL
+ */
+static void* lcdc_worker(void* arg)
+{
+    lcdc_worker_t* const w = arg;
+    lcdc_pool_t* const pool = w->pool;
+    uint64_t batch = 0;
+
+    pthread_mutex_lock(&(pool->mutex));
+    while(1){
+        while(!pool->quit && pool->batch == batch){
+            pthread_cond_wait(&(pool->start), &(pool->mutex));
+        }
+        if(pool->quit) break;
+
+        batch = pool->batch;
+        lcdc_render_batch(pool, &(w->lines));
+        if(--pool->busy == 0){
+            pthread_cond_signal(&(pool->done));
+        }
+    }
+    pthread_mutex_unlock(&(pool->mutex));
+    return NULL;
+}
+
+/**
+ * @brief Renders lines with all the threads of the pool, the calling one included
+ * @param lcd LCD controler, with a pool of workers
+ * @param first first line to render
+ * @param end last line to render (excluded)
+ * @return error code
+ */
+static int lcdc_render_lines(lcdc_t* lcd, uint8_t first, uint8_t end)
+{
+    lcdc_pool_t* const pool = lcd->pool;
+
+    pthread_mutex_lock(&(pool->mutex));
+    pool->next = first;
+    pool->end = end;
+    pool->error = ERR_NONE;
+    pool->busy = pool->nb_workers;
+    ++pool->batch;
+    pthread_cond_broadcast(&(pool->start));
+
+    lcdc_render_batch(pool, &(lcd->lines));
+    while(pool->busy > 0){
+        pthread_cond_wait(&(pool->done), &(pool->mutex));
+    }
+    const int err = pool->error;
+    pthread_mutex_unlock(&(pool->mutex));
+    return err;
+}
+
+/**
+ * @brief Invalidates what the caches hold of an address of VRAM or OAM
+ * @param lcd LCD controler
+ * @param addr address written to
+ */
+static void lcdc_invalidate(lcdc_t* lcd, addr_t addr)
+{
+    if(IS_TILE_DATA(addr)){
+        lcd->tile_cache.dirty[(addr - TILE_SRC_ADDR_LOW) / TILE_SIZE] = 1;
+    } else if(addr >= GRAPH_RAM_START && addr <= GRAPH_RAM_END){
+        lcd->sprite_cache.dirty = 1;
+    }
+}
+
+/**
+ * @brief Gives the job of the pipeline being filled by the thread simulating the Game Boy
+ * @param p pipeline
+ * @return job
+ */
+static inline lcdc_job_t* lcdc_job(lcdc_pipeline_t* p)
+{
+    // only the thread simulating the Game Boy changes p->submitted
+    return &(p->jobs[p->submitted % PIPELINE_NB_JOBS]);
+}
+
+/**
+ * @brief Hands the job being filled over to the rendering thread, and starts the next one,
+ *        once the rendering thread is done with the job before
+ * @param p pipeline
+ * @param frame_done whether the frame is complete (VBlank)
+ * @return error code, of the rendering thread too
+ */
+static int lcdc_pipeline_submit(lcdc_pipeline_t* p, bit_t frame_done)
+{
+    lcdc_job_t* const job = lcdc_job(p);
+    if(!frame_done && job->nb_writes == 0 && job->first_line == job->end_line){
+        return ERR_NONE;
+    }
+    job->frame_done = frame_done;
+
+    pthread_mutex_lock(&(p->mutex));
+    ++p->submitted;
+    pthread_cond_signal(&(p->submitted_cond));
+    while(p->submitted - p->done >= PIPELINE_NB_JOBS){
+        pthread_cond_wait(&(p->done_cond), &(p->mutex));
+    }
+    const int err = p->error;
+    pthread_mutex_unlock(&(p->mutex));
+
+    lcdc_job_t* const next = lcdc_job(p);
+    next->first_line = next->end_line = 0;
+    next->nb_writes = 0;
+    next->frame_done = 0;
+    return err;
+}
+
+/**
+ * @brief Hands the job being filled over to the rendering thread, waits until it is done
+ *        with all of them and copies its framebuffer
+ * @param lcd LCD controler, with a pipeline
+ * @return error code
+ */
+static int lcdc_pipeline_wait(lcdc_t* lcd)
+{
+    lcdc_pipeline_t* const p = lcd->pipeline;
+    M_REQUIRE_NO_ERR(lcdc_pipeline_submit(p, 0));
+
+    pthread_mutex_lock(&(p->mutex));
+    while(p->done != p->submitted){
+        pthread_cond_wait(&(p->done_cond), &(p->mutex));
+    }
+    const int err = p->error;
+    pthread_mutex_unlock(&(p->mutex));
+
+    memcpy(lcd->framebuffer, p->shadow->framebuffer, sizeof(lcd->framebuffer));
+    return err;
+}
+
+/**
+ * @brief Renders lines of a job on the LCD controler of the rendering thread
+ * @param shadow LCD controler of the rendering thread
+ * @param job job replayed
+ * @param first first line to render
+ * @param end last line to render (excluded)
+ * @return error code
+ */
+static int lcdc_pipeline_render(lcdc_t* shadow, const lcdc_job_t* job, uint8_t first, uint8_t end)
+{
+    if(first >= end) return ERR_NONE;
+
+    memcpy(&(shadow->line_states[first]), &(job->states[first]), (size_t) (end - first) * sizeof(lcdc_line_state_t));
+    shadow->pool->first_pending = first;
+    shadow->pool->end_pending = end;
+    return lcdc_flush(shadow);
+}
+
+/**
+ * @brief Replays a job on the LCD controler of the rendering thread: each line is rendered
+ *        with VRAM and OAM as they were when it started, then the frame, if complete, is queued
+ * @param p pipeline
+ * @param job job to replay
+ * @return error code
+ */
+static int lcdc_pipeline_replay(lcdc_pipeline_t* p, const lcdc_job_t* job)
+{
+    lcdc_t* const shadow = p->shadow;
+
+    uint8_t line = job->first_line;
+    for(size_t i = 0; i < job->nb_writes; ++i){
+        const lcdc_journal_entry_t* const w = &(job->journal[i]);
+        if(w->line > line){
+            M_REQUIRE_NO_ERR(lcdc_pipeline_render(shadow, job, line, w->line));
+            line = w->line;
+        }
+        shadow->pool->mirror[w->addr] = w->value;
+        lcdc_invalidate(shadow, w->addr);
+    }
+    M_REQUIRE_NO_ERR(lcdc_pipeline_render(shadow, job, line, job->end_line));
+
+    if(job->frame_done){
+        // the frame is dropped if the queue is full (its changes then go with the next one)
+        const size_t tail = atomic_load_explicit(&(p->tail), memory_order_relaxed);
+        if(tail - atomic_load_explicit(&(p->head), memory_order_acquire) < LCDC_FRAME_QUEUE_SIZE){
+            memcpy(p->frames[tail % LCDC_FRAME_QUEUE_SIZE], shadow->framebuffer, sizeof(lcdc_framebuffer_t));
+            memcpy(p->dirty[tail % LCDC_FRAME_QUEUE_SIZE], shadow->dirty_lines, sizeof(shadow->dirty_lines));
+            memset(shadow->dirty_lines, 0, sizeof(shadow->dirty_lines));
+            atomic_store_explicit(&(p->tail), tail + 1, memory_order_release);
+        }
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Body of the rendering thread of the pipeline: replays the jobs, until asked to quit
+ * @param arg pipeline (lcdc_pipeline_t)
+ * @return NULL
+ */
+static void* lcdc_pipeline_thread(void* arg)
+{
+    lcdc_pipeline_t* const p = arg;
+
+    pthread_mutex_lock(&(p->mutex));
+    while(1){
+        while(!p->quit && p->done == p->submitted){
+            pthread_cond_wait(&(p->submitted_cond), &(p->mutex));
+        }
+        if(p->done == p->submitted) break; // asked to quit, with nothing left to replay
+
+        const lcdc_job_t* const job = &(p->jobs[p->done % PIPELINE_NB_JOBS]);
+        pthread_mutex_unlock(&(p->mutex));
+        const int err = lcdc_pipeline_replay(p, job);
+        pthread_mutex_lock(&(p->mutex));
+        if(err != ERR_NONE && p->error == ERR_NONE){
+            p->error = err;
+        }
+        ++p->done;
+        pthread_cond_broadcast(&(p->done_cond));
+    }
+    pthread_mutex_unlock(&(p->mutex));
+    return NULL;
+}
+
+// ==== see lcdc.h ========================================
+int lcdc_flush(lcdc_t* lcd)
+{
+    M_REQUIRE_NON_NULL(lcd);
+
+    if(lcd->pipeline != NULL){
+        return lcdc_pipeline_wait(lcd);
+    }
+
+    lcdc_pool_t* const pool = lcd->pool;
+    if(pool == NULL || pool->first_pending == pool->end_pending){
+        return ERR_NONE;
+    }
+    uint8_t first = pool->first_pending;
+    const uint8_t end = pool->end_pending;
+    pool->first_pending = pool->end_pending = 0;
+
+    // the workers only read the caches: bring them up to date first
+    for(size_t tile = 0; tile < TILE_NB; ++tile){
+        if(lcd->tile_cache.dirty[tile]){
+            lcdc_decode_tile(lcd, tile);
+        }
+    }
+
+    while(first < end){
+        // the lines drawn with sprites of another size need other sprite lists
+        const data_t lcdc = lcd->line_states[first].lcdc;
+        uint8_t stop = (uint8_t) (first + 1);
+        while(stop < end && !((lcd->line_states[stop].lcdc ^ lcdc) & LCDC_REG_OBJ_SIZE_MASK)){
+            ++stop;
+        }
+        lcdc_update_sprite_lists(lcd, lcdc);
+
+        M_REQUIRE_NO_ERR(lcdc_render_lines(lcd, first, stop));
+        first = stop;
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Starts rendering a line (at mode 3 entry): renders it right away,
+ *        or leaves it to the workers or to the pipeline if there are some
+ * @param lcd LCD controler
+ * @param ly line to render
+ * @return error code
+ */
+static int lcdc_start_line(lcdc_t* lcd, uint8_t ly)
+{
+    lcdc_capture_line(lcd, ly);
+
+    if(lcd->pipeline != NULL){
+        lcdc_job_t* const job = lcdc_job(lcd->pipeline);
+        if(job->first_line == job->end_line){
+            job->first_line = ly;
+        }
+        job->states[ly] = lcd->line_states[ly];
+        job->end_line = (uint8_t) (ly + 1);
+        return ERR_NONE;
+    }
+
+    lcdc_pool_t* const pool = lcd->pool;
+    if(pool == NULL){
+        return lcdc_render_line(lcd, &(lcd->lines), ly);
+    }
+
+    if(pool->first_pending == pool->end_pending){
+        pool->first_pending = ly;
+    }
+    pool->end_pending = (uint8_t) (ly + 1);
+    return ERR_NONE;
+}
+
+/**
+ * @brief Takes a write to VRAM or OAM into account: the pending lines are rendered first,
+ *        with the memory as it was, then the caches are invalidated.
+ *        With the pipeline, the write is only journaled, for the rendering thread.
+ * @param lcd LCD controler
+ * @param addr address written to
+ * @return error code
+ */
+static int lcdc_video_written(lcdc_t* lcd, addr_t addr)
+{
+    lcdc_pipeline_t* const p = lcd->pipeline;
+    if(p != NULL){
+        if(lcdc_job(p)->nb_writes == PIPELINE_JOURNAL_SIZE){
+            M_REQUIRE_NO_ERR(lcdc_pipeline_submit(p, 0));
+        }
+        lcdc_job_t* const job = lcdc_job(p);
+        lcdc_journal_entry_t* const w = &(job->journal[job->nb_writes++]);
+        w->addr = addr;
+        w->value = lcdc_read(lcd, addr);
+        w->line = job->end_line;
+        return ERR_NONE;
+    }
+
+    if(lcd->pool != NULL){
+        M_REQUIRE_NO_ERR(lcdc_flush(lcd));
+        lcd->pool->mirror[addr] = lcdc_read(lcd, addr);
+    }
+    lcdc_invalidate(lcd, addr);
+    return ERR_NONE;
+}
+
+/**
+ * @brief Handles the LCDC event (mode change) of the given cycle
+ * @param lcd LCD controler
+ * @param cycle cycle of the event
+ * @return error code
+ */
+static int lcdc_event(lcdc_t* lcd, uint64_t cycle)
+{
+    const uint64_t frame_cycle = (cycle - lcd->on_cycle) % FRAME_TOTAL_CYCLES;
+    if(frame_cycle == 0){
+        lcd->window_y = 0;
+    }
+
+    const uint8_t ly = (uint8_t) (frame_cycle / LINE_TOTAL_CYCLES);
+    const uint64_t line_cycle = frame_cycle % LINE_TOTAL_CYCLES;
+
+    if(ly >= LCD_HEIGHT){
+        M_REQUIRE(line_cycle == 0, ERR_BAD_PARAMETER, "unexpected VBlank event at cycle %" PRIu64, cycle);
+        if(ly == LCD_HEIGHT){
+            if(lcd->pipeline != NULL){
+                // the rendering thread completes the frame while the next one starts
+                M_REQUIRE_NO_ERR(lcdc_pipeline_submit(lcd->pipeline, 1));
+            } else {
+                M_REQUIRE_NO_ERR(lcdc_flush(lcd));
+            }
+            lcdc_set_mode(lcd, MODE_VBLANK);
+            cpu_request_interrupt(lcd->cpu, VBLANK);
+        }
+        lcdc_write(lcd, REG_LY, ly);
+        lcdc_update_lyc(lcd);
+        lcd->next_cycle += LINE_TOTAL_CYCLES;
+        return ERR_NONE;
+    }
+
+    switch(line_cycle){
+    case LINE_MODE_2_START_CYCLE:
+        lcdc_write(lcd, REG_LY, ly);
+        lcdc_update_lyc(lcd);
+        lcdc_set_mode(lcd, MODE_OAM);
+        lcd->next_cycle += LINE_MODE_2_CYCLES;
+        break;
+
+    case LINE_MODE_3_START_CYCLE:
+        lcdc_set_mode(lcd, MODE_VRAM);
+        M_REQUIRE_NO_ERR(lcdc_start_line(lcd, ly));
+        lcd->next_cycle += LINE_MODE_3_CYCLES;
+        break;
+
+    case LINE_MODE_0_START_CYCLE:
+        lcdc_set_mode(lcd, MODE_HBLANK);
+        lcd->next_cycle += LINE_MODE_0_CYCLES;
+        break;
+
+    default:
+        M_EXIT(ERR_BAD_PARAMETER, "unexpected event at cycle %" PRIu64, cycle);
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Allocates the scratch lines needed to render a line
+ * @param l lines to allocate
+ * @return error code
+ */
+static int lcdc_lines_create(lcdc_lines_t* l)
+{
+    zero_init_ptr(l);
+    l->opacity = bit_vector_create(LCD_WIDTH, 0);
+    if(l->opacity == NULL ||
+       image_line_create(&(l->tiles), TILE_LINE_SIZE * TILE_HEIGHT) != ERR_NONE ||
+       image_line_create(&(l->window), VISIBLE_LINE_SIZE * TILE_HEIGHT) != ERR_NONE ||
+       image_line_create(&(l->line), LCD_WIDTH) != ERR_NONE ||
+       image_line_create(&(l->sprite), LCD_WIDTH) != ERR_NONE ||
+       image_line_create(&(l->tmp), LCD_WIDTH) != ERR_NONE ||
+       image_line_create(&(l->back), LCD_WIDTH) != ERR_NONE ||
+       image_line_create(&(l->front), LCD_WIDTH) != ERR_NONE){
+        return ERR_MEM;
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Frees the scratch lines allocated by lcdc_lines_create()
+ * @param l lines to free
+ */
+static void lcdc_lines_free(lcdc_lines_t* l)
+{
+    image_line_free(&(l->tiles));
+    image_line_free(&(l->window));
+    image_line_free(&(l->line));
+    image_line_free(&(l->sprite));
+    image_line_free(&(l->tmp));
+    image_line_free(&(l->back));
+    image_line_free(&(l->front));
+    bit_vector_free(&(l->opacity));
+}
+
+/**
+ * @brief Stops and frees the workers of a LCD controler (if any)
+ * @param lcd LCD controler
+ */
+static void lcdc_pool_free(lcdc_t* lcd)
+{
+    lcdc_pool_t* const pool = lcd->pool;
+    if(pool == NULL) return;
+
+    pthread_mutex_lock(&(pool->mutex));
+    pool->quit = 1;
+    pthread_cond_broadcast(&(pool->start));
+    pthread_mutex_unlock(&(pool->mutex));
+
+    for(size_t i = 0; i < pool->nb_workers; ++i){
+        pthread_join(pool->workers[i].thread, NULL);
+        lcdc_lines_free(&(pool->workers[i].lines));
+    }
+    pthread_cond_destroy(&(pool->done));
+    pthread_cond_destroy(&(pool->start));
+    pthread_mutex_destroy(&(pool->mutex));
+    free(pool->workers);
+    free(pool);
+    lcd->pool = NULL;
+}
+
+/**
+ * @brief Starts the workers of a LCD controler
+ * @param lcd LCD controler, without workers
+ * @param nb_workers number of workers to start
+ * @return error code
+ */
+static int lcdc_pool_create(lcdc_t* lcd, size_t nb_workers)
+{
+    lcdc_pool_t* const pool = calloc(1, sizeof(lcdc_pool_t));
+    if(pool == NULL) return ERR_MEM;
+    pool->workers = calloc(nb_workers, sizeof(lcdc_worker_t));
+    if(pool->workers == NULL && nb_workers > 0){
+        free(pool);
+        return ERR_MEM;
+    }
+
+    pool->lcd = lcd;
+    pthread_mutex_init(&(pool->mutex), NULL);
+    pthread_cond_init(&(pool->start), NULL);
+    pthread_cond_init(&(pool->done), NULL);
+    for(addr_t a = VIDEO_RAM_START; a <= VIDEO_RAM_END; ++a){
+        pool->mirror[a] = lcdc_read(lcd, a);
+    }
+    for(addr_t a = GRAPH_RAM_START; a <= GRAPH_RAM_END; ++a){
+        pool->mirror[a] = lcdc_read(lcd, a);
+    }
+    lcd->pool = pool;
+
+    // lcdc_pool_free() stops the workers started so far if one cannot be
+    for(size_t i = 0; i < nb_workers; ++i){
+        lcdc_worker_t* const w = &(pool->workers[i]);
+        w->pool = pool;
+        if(lcdc_lines_create(&(w->lines)) != ERR_NONE ||
+           pthread_create(&(w->thread), NULL, lcdc_worker, w) != 0){
+            lcdc_lines_free(&(w->lines));
+            lcdc_pool_free(lcd);
+            return ERR_MEM;
+        }
+        ++pool->nb_workers;
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Stops and frees the rendering pipeline of a LCD controler (if any)
+ * @param lcd LCD controler
+ */
+static void lcdc_pipeline_free(lcdc_t* lcd)
+{
+    lcdc_pipeline_t* const p = lcd->pipeline;
+    if(p == NULL) return;
+
+    pthread_mutex_lock(&(p->mutex));
+    p->quit = 1;
+    pthread_cond_signal(&(p->submitted_cond));
+    pthread_mutex_unlock(&(p->mutex));
+    pthread_join(p->thread, NULL);
+
+    pthread_cond_destroy(&(p->done_cond));
+    pthread_cond_destroy(&(p->submitted_cond));
+    pthread_mutex_destroy(&(p->mutex));
+    lcdc_free(p->shadow);
+    free(p->shadow);
+    free(p);
+    lcd->pipeline = NULL;
+}
+
+/**
+ * @brief Starts the rendering pipeline of a LCD controler
+ * @param lcd LCD controler, without pipeline nor workers, nor lines pending
+ * @return error code
+ */
+static int lcdc_pipeline_create(lcdc_t* lcd)
+{
+    lcdc_pipeline_t* const p = calloc(1, sizeof(lcdc_pipeline_t));
+    if(p == NULL) return ERR_MEM;
+
+    // the rendering thread renders from a mirror of VRAM and OAM (see lcdc_pool_t), without workers
+    lcdc_t* const shadow = calloc(1, sizeof(lcdc_t));
+    p->shadow = shadow;
+    if(shadow != NULL){
+        shadow->cpu = lcd->cpu;
+        memset(shadow->tile_cache.dirty, 1, sizeof(shadow->tile_cache.dirty));
+        shadow->sprite_cache.dirty = 1;
+        memcpy(shadow->framebuffer, lcd->framebuffer, sizeof(shadow->framebuffer));
+        memset(shadow->dirty_lines, 1, sizeof(shadow->dirty_lines)); // the first frame is presented in full
+    }
+    if(shadow == NULL || lcdc_lines_create(&(shadow->lines)) != ERR_NONE ||
+       lcdc_pool_create(shadow, 0) != ERR_NONE){
+        lcdc_free(shadow);
+        free(shadow);
+        free(p);
+        return ERR_MEM;
+    }
+    shadow->cpu = NULL; // never to touch the bus
+
+    pthread_mutex_init(&(p->mutex), NULL);
+    pthread_cond_init(&(p->submitted_cond), NULL);
+    pthread_cond_init(&(p->done_cond), NULL);
+    atomic_init(&(p->head), 0);
+    atomic_init(&(p->tail), 0);
+    if(pthread_create(&(p->thread), NULL, lcdc_pipeline_thread, p) != 0){
+        pthread_cond_destroy(&(p->done_cond));
+        pthread_cond_destroy(&(p->submitted_cond));
+        pthread_mutex_destroy(&(p->mutex));
+        lcdc_free(shadow);
+        free(shadow);
+        free(p);
+        return ERR_MEM;
+    }
+    lcd->pipeline = p;
+    return ERR_NONE;
+}
+
+// ==== see lcdc.h ========================================
+int lcdc_init(gameboy_t* gb)
+{
+    M_REQUIRE_NON_NULL(gb);
+
+    lcdc_t* const lcd = &(gb->screen);
+    lcd->cpu = &(gb->cpu);
+    lcd->on = (lcdc_read(lcd, REG_LCDC) & LCDC_REG_LCD_STATUS_MASK) != 0;
+    lcd->next_cycle = LCDC_NO_CYCLE;
+    lcd->on_cycle = lcd->on ? 0 : LCDC_NO_CYCLE;
+    lcd->DMA_from = 0;
+    lcd->DMA_to = GRAPH_RAM_END + 1; // no DMA transfer pending
+    lcd->window_y = 0;
+    lcd->cycles = 0;
+    memset(lcd->framebuffer, 0, sizeof(lcd->framebuffer));
+    memset(lcd->dirty_lines, 1, sizeof(lcd->dirty_lines)); // the first frame is presented in full
+    memset(lcd->tile_cache.dirty, 1, sizeof(lcd->tile_cache.dirty)); // nothing decoded yet
+    lcd->sprite_cache.dirty = 1;
+
+    lcd->pool = NULL;
+    lcd->pipeline = NULL;
+
+    // all the lines needed to render a scanline are allocated once and for all
+    if(lcdc_lines_create(&(lcd->lines)) != ERR_NONE){
+        lcdc_free(lcd);
+        return ERR_MEM;
+    }
+
+    return ERR_NONE;
+}
+
+// ==== see lcdc.h ========================================
+void lcdc_free(lcdc_t* lcd)
+{
+    if(lcd == NULL) return;
+
+    lcdc_pipeline_free(lcd);
+    lcdc_pool_free(lcd);
+    lcdc_lines_free(&(lcd->lines));
+}
+
+// ==== see lcdc.h ========================================
+int lcdc_plug(lcdc_t* lcd, bus_t bus _unused)
+{
+    M_REQUIRE_NON_NULL(lcd);
+
+    // the LCDC registers, VRAM and OAM are plain memory already on the bus
+    return ERR_NONE;
+}
+
+// ==== see lcdc.h ========================================
+int lcdc_set_render_threads(lcdc_t* lcd, size_t nb_threads)
+{
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE(nb_threads >= 1 && nb_threads <= LCD_HEIGHT, ERR_BAD_PARAMETER,
+              "invalid number of rendering threads (%zu)", nb_threads);
+    M_REQUIRE(nb_threads == 1 || lcd->pipeline == NULL, ERR_BAD_PARAMETER,
+              "the rendering pipeline renders with a single thread");
+
+    M_REQUIRE_NO_ERR(lcdc_flush(lcd));
+    lcdc_pool_free(lcd);
+    return nb_threads == 1 ? ERR_NONE : lcdc_pool_create(lcd, nb_threads - 1);
+}
+
+// ==== see lcdc.h ========================================
+int lcdc_set_pipeline(lcdc_t* lcd, bit_t on)
+{
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE(!on || lcd->pool == NULL, ERR_BAD_PARAMETER, "the rendering pipeline renders with a single thread");
+
+    M_REQUIRE_NO_ERR(lcdc_flush(lcd));
+    if(lcd->pipeline != NULL){
+        lcdc_pipeline_free(lcd);
+        // VRAM and OAM were written behind the back of the caches
+        memset(lcd->tile_cache.dirty, 1, sizeof(lcd->tile_cache.dirty));
+        lcd->sprite_cache.dirty = 1;
+    }
+    return on ? lcdc_pipeline_create(lcd) : ERR_NONE;
+}
+
+// ==== see lcdc.h ========================================
+bit_t lcdc_pop_frame(lcdc_t* lcd, lcdc_framebuffer_t* frame, bit_t* dirty)
+{
+    if(lcd == NULL || frame == NULL || lcd->pipeline == NULL) return 0;
+
+    lcdc_pipeline_t* const p = lcd->pipeline;
+    const size_t head = atomic_load_explicit(&(p->head), memory_order_relaxed);
+    if(head == atomic_load_explicit(&(p->tail), memory_order_acquire)) return 0;
+
+    memcpy(*frame, p->frames[head % LCDC_FRAME_QUEUE_SIZE], sizeof(lcdc_framebuffer_t));
+    if(dirty != NULL){
+        for(size_t y = 0; y < LCD_HEIGHT; ++y){
+            dirty[y] |= p->dirty[head % LCDC_FRAME_QUEUE_SIZE][y];
+        }
+    }
+    atomic_store_explicit(&(p->head), head + 1, memory_order_release);
+    return 1;
+}
+
+// ==== see lcdc.h ========================================
+int lcdc_cycle(lcdc_t* lcd, uint64_t cycle)
+{
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE(cycle <= lcd->next_cycle, ERR_BAD_PARAMETER, "cycle %" PRIu64 " is past the next event (%" PRIu64 ")", cycle, lcd->next_cycle);
+
+    // OAM DMA copies one byte per cycle
+    if(lcd->DMA_to <= GRAPH_RAM_END){
+        const addr_t to = lcd->DMA_to++;
+        lcdc_write(lcd, to, lcdc_read(lcd, lcd->DMA_from++));
+        M_REQUIRE_NO_ERR(lcdc_video_written(lcd, to));
+    }
+
+    if(cycle == lcd->next_cycle){
+        return lcdc_event(lcd, cycle);
+    }
+
+    if(lcd->next_cycle == LCDC_NO_CYCLE && (lcdc_read(lcd, REG_LCDC) & LCDC_REG_LCD_STATUS_MASK)){
+        // switched on: a frame starts right now
+        lcd->next_cycle = lcd->on_cycle = cycle;
+        return lcdc_event(lcd, cycle);
+    }
+    return ERR_NONE;
+}
+
+// ==== see lcdc.h ========================================
+int lcdc_bus_listener(lcdc_t* lcd, addr_t addr)
+{
+    M_REQUIRE_NON_NULL(lcd);
+
+    if(IS_VIDEO_MEMORY(addr)){
+        // 16-bit writes are only reported by their first address
+        M_REQUIRE_NO_ERR(lcdc_video_written(lcd, addr));
+        if(IS_VIDEO_MEMORY(addr + 1)){
+            M_REQUIRE_NO_ERR(lcdc_video_written(lcd, (addr_t) (addr + 1)));
+        }
+        return ERR_NONE;
+    }
+
+    switch(addr){
+    case REG_LCDC: {
+        const bit_t on = (lcdc_read(lcd, REG_LCDC) & LCDC_REG_LCD_STATUS_MASK) != 0;
+        if(lcd->on && !on){
+            // switched off: back to line 0, in HBlank, until switched on again
+            M_REQUIRE_NO_ERR(lcdc_flush(lcd));
+            lcdc_set_mode(lcd, MODE_HBLANK);
+            lcdc_write(lcd, REG_LY, 0);
+            lcdc_update_lyc(lcd);
+            lcd->next_cycle = LCDC_NO_CYCLE;
+        }
+        lcd->on = on;
+    } break;
+
+    case REG_LYC:
+        lcdc_update_lyc(lcd);
+        break;
+
+    case REG_DMA:
+        lcd->DMA_from = (addr_t) (lcdc_read(lcd, REG_DMA) << 8);
+        lcd->DMA_to = GRAPH_RAM_START;
+        break;
+    }
+    return ERR_NONE;
+}
+
+// ==== see lcdc.h ========================================
+uint64_t lcdc_next_event(const lcdc_t* lcd){
+    if(lcd == NULL || lcd->cpu == NULL)
+        return UINT64_MAX;
+
+    // DMA copies one byte per cycle, and switching on happens on the first cycle after the write
+    if(lcd->DMA_to <= GRAPH_RAM_END ||
+       (lcd->next_cycle == LCDC_NO_CYCLE && (lcdc_read(lcd, REG_LCDC) & LCDC_REG_LCD_STATUS_MASK))){
+        return lcd->cycles;
+    }
+
+    return lcd->next_cycle == LCDC_NO_CYCLE ? UINT64_MAX : lcd->next_cycle;
+}
+
+// ==== see lcdc.h ========================================
+uint64_t lcdc_next_vblank(const lcdc_t* lcd, uint64_t cycle){
+    if(lcd == NULL || lcd->cpu == NULL ||
+       !(lcdc_read(lcd, REG_LCDC) & LCDC_REG_LCD_STATUS_MASK))
+        return UINT64_MAX;
+
+    // frames are counted from the cycle the LCD was switched on (or is about to be)
+    const uint64_t on = lcd->next_cycle == LCDC_NO_CYCLE ? lcd->cycles : lcd->on_cycle;
+    const uint64_t first = on + LCD_HEIGHT * LINE_TOTAL_CYCLES;
+    if(cycle <= first)
+        return first;
+
+    return first + (cycle - first + FRAME_TOTAL_CYCLES - 1) / FRAME_TOTAL_CYCLES * FRAME_TOTAL_CYCLES;
+}
+
+// ==== see lcdc.h ========================================
+int lcdc_catch_up(lcdc_t* lcd, uint64_t target_cycle){
+    M_REQUIRE_NON_NULL(lcd);
+
+    while(lcd->cycles < target_cycle){
+        const uint64_t next = lcdc_next_event(lcd);
+        if(next >= target_cycle){
+            lcd->cycles = target_cycle;
+        } else {
+            M_REQUIRE_NO_ERR(lcdc_cycle(lcd, next));
+            lcd->cycles = next + 1;
+        }
+    }
+
+    return ERR_NONE;
+}
+
+// ==== see lcdc.h ========================================
+const uint8_t* lcdc_framebuffer(const lcdc_t* lcd){
+    return lcd == NULL ? NULL : &(lcd->framebuffer[0][0]);
+}
+
+// ==== see lcdc.h ========================================
+bit_t lcdc_take_dirty_lines(lcdc_t* lcd, bit_t* dirty)
+{
+    if(lcd == NULL || dirty == NULL) return 0;
+
+    bit_t changed = 0;
+    for(size_t y = 0; y < LCD_HEIGHT; ++y){
+        changed |= lcd->dirty_lines[y];
+        dirty[y] |= lcd->dirty_lines[y];
+    }
+    memset(lcd->dirty_lines, 0, sizeof(lcd->dirty_lines));
+    return changed;
+}
+
+// ==== see lcdc.h ========================================
+int lcdc_to_image(const lcdc_t* lcd, image_t* output){
+    M_REQUIRE_NON_NULL(lcd);
+    M_REQUIRE_NON_NULL(output);
+
+    M_REQUIRE_NO_ERR(image_create(output, LCD_WIDTH, LCD_HEIGHT));
+
+    for(size_t y = 0; y < LCD_HEIGHT; ++y){
+        const uint8_t* const pixels = lcd->framebuffer[y];
+        for(size_t w = 0; w < LCD_WIDTH / IMAGE_LINE_WORD_BITS; ++w){
+            uint32_t msb = 0;
+            uint32_t lsb = 0;
+            for(size_t i = 0; i < IMAGE_LINE_WORD_BITS; ++i){
+                const uint8_t p = pixels[w * IMAGE_LINE_WORD_BITS + i];
+                msb |= (uint32_t) ((p >> 1) & 1) << i;
+                lsb |= (uint32_t) (p & 1) << i;
+            }
+            M_EXIT_IF_ERR_DO_SOMETHING(image_line_set_word(&(output->content[y]), w, msb, lsb), image_free(output));
+        }
+    }
+    return ERR_NONE;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -85,15 +85,95 @@ extern "C" {
 #define TILE_SRC_ADDR_HIGH 0x8800
 
 #define TILE_SIZE 16      // tile size (in bytes)
+#define TILE_HEIGHT 8     // tile height (in pixel lines)
+
+#define TILE_SRC_ADDR_END 0x97FF
+#define TILE_NB ((TILE_SRC_ADDR_END - TILE_SRC_ADDR_LOW + 1) / TILE_SIZE) // 384 tiles in VRAM
+
+// true if the address is in the tile data of VRAM
+#define IS_TILE_DATA(addr) ((addr) >= TILE_SRC_ADDR_LOW && (addr) <= TILE_SRC_ADDR_END)
 
 #define TILE_LINE_SIZE    32
 #define VISIBLE_LINE_SIZE 20
 
 
+// Sprites
+
+#define LINE_MAX_SPRITES 10 // sprites drawn on a line, at most
+
+
 // Window
 
 #define WINDOW_OFFSET_X  7
 
+// ======================================================================
+/**
+ * @brief Packed display: one byte (color 0 to 3, after palette) per pixel, line after line
+ */
+typedef uint8_t lcdc_framebuffer_t[LCD_HEIGHT][LCD_WIDTH];
+
+// ======================================================================
+/**
+ * @brief Lines a scanline is composed in, allocated once by lcdc_init()
+ */
+typedef struct {
+    image_line_t tiles;  // background map line (TILE_LINE_SIZE tiles)
+    image_line_t window; // window map line (VISIBLE_LINE_SIZE tiles)
+    image_line_t line;   // scanline being composed
+    image_line_t sprite; // tile line of one sprite
+    image_line_t tmp;
+    image_line_t back;   // all the sprites of the scanline
+    image_line_t front;  // the sprites of the scanline drawn above the background
+    bit_vector_t* opacity;
+} lcdc_lines_t;
+
+// ======================================================================
+/**
+ * @brief The tiles of VRAM, decoded in image line order (bit 0 is the leftmost pixel);
+ *        a tile written to (see lcdc_bus_listener()) is decoded again when next used
+ */
+typedef struct {
+    uint8_t lsb[TILE_NB][TILE_HEIGHT];
+    uint8_t msb[TILE_NB][TILE_HEIGHT];
+    bit_t   dirty[TILE_NB];
+} lcdc_tile_cache_t;
+
+// ======================================================================
+/**
+ * @brief The sprites of each line, rebuilt when first needed after a change of OAM
+ *        (see lcdc_bus_listener()) or of the size of the sprites
+ */
+typedef struct {
+    uint8_t sprites[LCD_HEIGHT][LINE_MAX_SPRITES]; // OAM indexes, by decreasing priority
+    uint8_t nb_sprites[LCD_HEIGHT];
+    data_t  obj_size; // LCDC_REG_OBJ_SIZE_MASK bit of LCDC the lists were built with
+    bit_t   dirty;
+} lcdc_sprite_cache_t;
+
+// ======================================================================
+/**
+ * @brief The registers a line is rendered with, captured when it starts (mode 3)
+ */
+typedef struct {
+    data_t lcdc;
+    data_t scy;
+    data_t scx;
+    data_t bgp;
+    data_t obp0;
+    data_t obp1;
+    data_t wx;
+    data_t window_y; // line of the window drawn on this line, if any
+    bit_t  window;   // whether the window shows on this line
+} lcdc_line_state_t;
+
+// workers rendering lines in parallel (see lcdc_set_render_threads())
+typedef struct lcdc_pool_ lcdc_pool_t;
+
+// thread rendering the display of a frame while the next one is emulated (see lcdc_set_pipeline())
+typedef struct lcdc_pipeline_ lcdc_pipeline_t;
+
+#define LCDC_FRAME_QUEUE_SIZE 4 // frames completed by the pipeline, not taken yet, at most
+
 // ======================================================================
 /**
  * @brief lcdc type
@@ -105,8 +185,16 @@ typedef struct {
     uint64_t on_cycle;
     addr_t   DMA_from;
     addr_t   DMA_to;
-    image_t  display;
+    lcdc_framebuffer_t framebuffer; // written by the renderer (see lcdc_framebuffer())
+    bit_t dirty_lines[LCD_HEIGHT];  // lines of the framebuffer changed (see lcdc_take_dirty_lines())
+    lcdc_lines_t lines;
+    lcdc_tile_cache_t tile_cache;
+    lcdc_sprite_cache_t sprite_cache;
+    lcdc_line_state_t line_states[LCD_HEIGHT];
+    lcdc_pool_t* pool; // NULL when each line is rendered as it starts
+    lcdc_pipeline_t* pipeline; // NULL when rendered by the thread simulating the Game Boy
     data_t   window_y;
+    uint64_t cycles; // number of cycles already simulated (see lcdc_catch_up())
 } lcdc_t;
 
 
@@ -135,6 +223,62 @@ void lcdc_free(lcdc_t* lcd);
 int lcdc_plug(lcdc_t* lcd, bus_t bus);
 
 
+/**
+ * @brief Sets the number of threads rendering the display. With 1 (the default), each line
+ *        is rendered as it starts; with more, the registers of each line are only captured
+ *        when it starts, and the lines are rendered in parallel (the calling thread included)
+ *        at VBlank, or before VRAM or OAM change (see lcdc_bus_listener()).
+ *        Both give the very same display.
+ *
+ * @param lcd LCD controler
+ * @param nb_threads number of threads, from 1 to LCD_HEIGHT
+ * @return error code
+ */
+int lcdc_set_render_threads(lcdc_t* lcd, size_t nb_threads);
+
+
+/**
+ * @brief Switches the rendering pipeline on or off. When on, a thread of its own renders
+ *        the display of a frame while the next one is emulated: the registers of each line
+ *        and the writes to VRAM and OAM are journaled, and replayed by the rendering thread
+ *        on its own copy of VRAM and OAM. The frames completed are queued, to be taken
+ *        with lcdc_pop_frame(); the framebuffer of the LCD controler itself is then only
+ *        updated by lcdc_flush().
+ *        Only possible with a single rendering thread (see lcdc_set_render_threads()).
+ *
+ * @param lcd LCD controler
+ * @param on whether to render on a thread of its own
+ * @return error code
+ */
+int lcdc_set_pipeline(lcdc_t* lcd, bit_t on);
+
+
+/**
+ * @brief Takes the oldest frame completed by the rendering pipeline (see lcdc_set_pipeline()),
+ *        without waiting. May be called from another thread than the one simulating the Game Boy,
+ *        but always the same one. When LCDC_FRAME_QUEUE_SIZE frames are waiting, the next ones
+ *        are dropped.
+ *
+ * @param lcd LCD controler
+ * @param frame (modified) frame taken
+ * @param dirty (modified, may be NULL) LCD_HEIGHT flags: those of the lines that differ from
+ *        the frame taken before (or dropped since) are set, the others are left as they are
+ * @return whether a frame was taken
+ */
+bit_t lcdc_pop_frame(lcdc_t* lcd, lcdc_framebuffer_t* frame, bit_t* dirty);
+
+
+/**
+ * @brief Renders the lines captured but not rendered yet (see lcdc_set_render_threads()),
+ *        or waits for the rendering pipeline to be done with them (see lcdc_set_pipeline()),
+ *        so that the display is up to date
+ *
+ * @param lcd LCD controler
+ * @return error code
+ */
+int lcdc_flush(lcdc_t* lcd);
+
+
 /**
  * @brief Run one LCD controler cycle
  *
@@ -146,7 +290,40 @@ int lcdc_cycle(lcdc_t* lcd, uint64_t cycle);
 
 
 /**
- * @brief LCD controler bus listening handler
+ * @brief Brings a LCD controler up to date, i.e. simulates it for all the cycles
+ *        before target_cycle, skipping the ones where nothing happens
+ *
+ * @param lcd LCD controler to catch up
+ * @param target_cycle first cycle not to simulate
+ * @return error code
+ */
+int lcdc_catch_up(lcdc_t* lcd, uint64_t target_cycle);
+
+
+/**
+ * @brief Computes the next cycle at which the LCD controler has something to do
+ *        (and thus may raise an interrupt)
+ *
+ * @param lcd LCD controler to check
+ * @return cycle of the next event, UINT64_MAX if the LCD is off
+ */
+uint64_t lcdc_next_event(const lcdc_t* lcd);
+
+
+/**
+ * @brief Computes the first cycle, not before the given one, at which the LCD controler
+ *        enters VBlank (i.e. has drawn a full frame)
+ *
+ * @param lcd LCD controler to check
+ * @param cycle cycle to start from
+ * @return cycle of the next VBlank start, UINT64_MAX if the LCD is off
+ */
+uint64_t lcdc_next_vblank(const lcdc_t* lcd, uint64_t cycle);
+
+
+/**
+ * @brief LCD controler bus listening handler, to be called after every write
+ *        to its registers, to VRAM and to OAM
  *
  * @param lcd LCD controler
  * @param address trigger address
@@ -154,6 +331,38 @@ int lcdc_cycle(lcdc_t* lcd, uint64_t cycle);
  */
 int lcdc_bus_listener(lcdc_t* lcd, addr_t addr);
 
+
+/**
+ * @brief Gives direct (read-only) access to the display of a LCD controler
+ *
+ * @param lcd LCD controler
+ * @return LCD_HEIGHT lines of LCD_WIDTH pixels (see lcdc_framebuffer_t), NULL on error
+ */
+const uint8_t* lcdc_framebuffer(const lcdc_t* lcd);
+
+
+/**
+ * @brief Takes the lines of the display that changed since the last call (all of them
+ *        at first), so that only they are presented again; a line is changed when its
+ *        pixels differ once rendered. With the pipeline, see lcdc_pop_frame() instead.
+ *
+ * @param lcd LCD controler
+ * @param dirty (modified) LCD_HEIGHT flags: those of the lines changed are set,
+ *        the others are left as they are
+ * @return whether some line changed
+ */
+bit_t lcdc_take_dirty_lines(lcdc_t* lcd, bit_t* dirty);
+
+
+/**
+ * @brief Converts the display of a LCD controler into an image
+ *
+ * @param lcd LCD controler
+ * @param output image to create (to be freed by the caller with image_free())
+ * @return error code
+ */
+int lcdc_to_image(const lcdc_t* lcd, image_t* output);
+
 #ifdef __cplusplus
 }
 #endif
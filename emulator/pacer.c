@@ -0,0 +1,181 @@
+/**
+ * @file pacer.c
+ * @brief Real-time pacing of the emulation, one Game Boy frame at a time
+ *
+ * @author E. Wengle, E. Garandel, EPFL
+ * @date 2020
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <math.h>
+#include <inttypes.h> // PRIu64
+
+#include "pacer.h"
+#include "gameboy.h" // GB_CYCLES_PER_S
+#include "lcdc.h"    // FRAME_TOTAL_CYCLES
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NS_PER_S 1000000000ull
+
+// duration of the given number of Game Boy cycles, in ns (split to avoid overflows)
+#define cycles_to_ns(cycles) \
+    (((cycles) / GB_CYCLES_PER_S) * NS_PER_S + ((cycles) % GB_CYCLES_PER_S) * NS_PER_S / GB_CYCLES_PER_S)
+
+// number of Game Boy cycles in the given duration, in ns (split to avoid overflows)
+#define ns_to_cycles(ns) \
+    (((ns) / NS_PER_S) * GB_CYCLES_PER_S + ((ns) % NS_PER_S) * GB_CYCLES_PER_S / NS_PER_S)
+
+// deadline of the given frame of a pacer, in ns
+#define frame_deadline(pacer, frame) \
+    ((pacer)->origin + cycles_to_ns((frame) * FRAME_TOTAL_CYCLES))
+
+/**
+ * @brief Reads CLOCK_MONOTONIC
+ * @param ns (modified) current time, in ns
+ * @return error code
+ */
+static int now_ns(uint64_t* ns)
+{
+    struct timespec now;
+    M_REQUIRE(clock_gettime(CLOCK_MONOTONIC, &now) == 0, ERR_IO, "%s", "cannot read the monotonic clock");
+    *ns = (uint64_t) now.tv_sec * NS_PER_S + (uint64_t) now.tv_nsec;
+    return ERR_NONE;
+}
+
+/**
+ * @brief Counts the frames due by now, the first of which is late, bounded by max_frames:
+ *        beyond, late frames are dropped and the schedule is rebased on now
+ * @param pacer pacer to catch up
+ * @param now current time (CLOCK_MONOTONIC, in ns), past the deadline of the next frame
+ * @param max_frames maximal number of frames to catch up at once
+ * @param nb_frames (modified) number of frames to emulate now
+ */
+static void pacer_catch_up(pacer_t* pacer, uint64_t now, uint64_t max_frames, uint64_t* nb_frames)
+{
+    const uint64_t last = ns_to_cycles(now - pacer->origin) / FRAME_TOTAL_CYCLES; // (up to rounding)
+    const uint64_t due = last >= pacer->frames ? last + 1 - pacer->frames : 1;
+    if(due <= max_frames){
+        pacer->frames += due;
+        *nb_frames = due;
+    } else {
+        pacer->nb_dropped += due - max_frames;
+        pacer->frames = 1;
+        pacer->origin = now;
+        *nb_frames = max_frames;
+    }
+}
+
+// ==== see pacer.h ========================================
+int pacer_init(pacer_t* pacer)
+{
+    M_REQUIRE_NON_NULL(pacer);
+
+    pacer->nb_waits = 0;
+    pacer->nb_late = 0;
+    pacer->nb_dropped = 0;
+    pacer->nb_ticks = 0;
+    pacer->jitter_max = 0;
+    pacer->jitter_sum = 0;
+    pacer->jitter_sum2 = 0;
+    return pacer_restart(pacer);
+}
+
+// ==== see pacer.h ========================================
+int pacer_restart(pacer_t* pacer)
+{
+    M_REQUIRE_NON_NULL(pacer);
+
+    pacer->frames = 0;
+    return now_ns(&(pacer->origin));
+}
+
+// ==== see pacer.h ========================================
+int pacer_wait(pacer_t* pacer, uint64_t max_frames, uint64_t* nb_frames)
+{
+    M_REQUIRE_NON_NULL(pacer);
+    M_REQUIRE_NON_NULL(nb_frames);
+    M_REQUIRE(max_frames > 0, ERR_BAD_PARAMETER, "%s", "at least one frame must be allowed");
+
+    const uint64_t deadline = frame_deadline(pacer, pacer->frames);
+
+    uint64_t now = 0;
+    M_REQUIRE_NO_ERR(now_ns(&now));
+    if(now > deadline){
+        // late (stall, window drag...): catch up on the frames due without waiting
+        pacer_catch_up(pacer, now, max_frames, nb_frames);
+        pacer->nb_late += *nb_frames;
+        return ERR_NONE;
+    }
+
+    pacer->frames += 1;
+    *nb_frames = 1;
+
+    const struct timespec until = { (time_t) (deadline / NS_PER_S), (long) (deadline % NS_PER_S) };
+    int err = 0;
+    do {
+        err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+    } while(err == EINTR);
+    M_REQUIRE(err == 0, ERR_IO, "%s", "cannot sleep until the next frame");
+
+    M_REQUIRE_NO_ERR(now_ns(&now));
+    const uint64_t jitter = now > deadline ? now - deadline : 0;
+    pacer->nb_waits += 1;
+    pacer->jitter_sum += (double) jitter;
+    pacer->jitter_sum2 += (double) jitter * (double) jitter;
+    if(jitter > pacer->jitter_max){
+        pacer->jitter_max = jitter;
+    }
+    return ERR_NONE;
+}
+
+// ==== see pacer.h ========================================
+int pacer_tick(pacer_t* pacer, uint64_t now, uint64_t refresh, uint64_t max_frames, uint64_t* nb_frames)
+{
+    M_REQUIRE_NON_NULL(pacer);
+    M_REQUIRE_NON_NULL(nb_frames);
+    M_REQUIRE(max_frames > 0, ERR_BAD_PARAMETER, "%s", "at least one frame must be allowed");
+
+    const double frame = (double) cycles_to_ns(FRAME_TOTAL_CYCLES);
+    if(refresh > 0 && fabs((double) refresh - frame) <= PACER_RATE_TOLERANCE * frame){
+        // same rate: the display drives the emulation, and the schedule follows it
+        pacer->origin = now;
+        pacer->frames = 1;
+        *nb_frames = 1;
+    } else if(now < frame_deadline(pacer, pacer->frames)){
+        // other rate: the frame shown is shown once more (display faster)...
+        *nb_frames = 0;
+    } else {
+        // ...or the frames due are emulated, only the last one being shown (display slower)
+        pacer_catch_up(pacer, now, max_frames, nb_frames);
+    }
+    pacer->nb_ticks += *nb_frames;
+    return ERR_NONE;
+}
+
+// ==== see pacer.h ========================================
+int pacer_print_stats(const pacer_t* pacer, FILE* output)
+{
+    M_REQUIRE_NON_NULL(pacer);
+    M_REQUIRE_NON_NULL(output);
+
+    const double n = pacer->nb_waits > 0 ? (double) pacer->nb_waits : 1.0;
+    const double mean = pacer->jitter_sum / n;
+    const double var = pacer->jitter_sum2 / n - mean * mean;
+
+    fprintf(output, "pacing: %" PRIu64 " frames on time, %" PRIu64 " late, %" PRIu64 " on display refreshes, "
+            "%" PRIu64 " dropped, wake-up jitter (us): mean %.1f, stddev %.1f, max %.1f\n",
+            pacer->nb_waits, pacer->nb_late, pacer->nb_ticks, pacer->nb_dropped, mean / 1e3, (var > 0 ? sqrt(var) : 0) / 1e3,
+            (double) pacer->jitter_max / 1e3);
+    return ERR_NONE;
+}
+
+#ifdef __cplusplus
+}
+#endif
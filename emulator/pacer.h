@@ -0,0 +1,103 @@
+#pragma once
+
+/**
+ * @file pacer.h
+ * @brief Real-time pacing of the emulation, one Game Boy frame at a time
+ *
+ * @author E. Wengle, E. Garandel, EPFL
+ * @date 2020
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// display refresh intervals that differ from the Game Boy frame duration by at most
+// this ratio count as the same rate (e.g. 60 Hz for 59.7275 Hz, see pacer_tick())
+#define PACER_RATE_TOLERANCE 0.01
+
+/**
+ * @brief Frame pacer type.
+ *        Frame deadlines are computed from an origin on CLOCK_MONOTONIC (and not from
+ *        the previous wake-up), so that sleeping inaccuracies do not accumulate.
+ */
+typedef struct {
+    uint64_t origin;     // CLOCK_MONOTONIC time of frame 0 (in ns)
+    uint64_t frames;     // number of frames since origin
+
+    // wake-up jitter statistics (lateness w.r.t. the deadline, in ns)
+    uint64_t nb_waits;
+    uint64_t nb_late;    // frames whose deadline had already passed (caught up without waiting)
+    uint64_t nb_dropped; // frames skipped altogether because too late (the schedule was then rebased)
+    uint64_t nb_ticks;   // frames emulated on display refreshes (see pacer_tick())
+    uint64_t jitter_max;
+    double   jitter_sum;
+    double   jitter_sum2;
+} pacer_t;
+
+
+/**
+ * @brief Initializes a pacer, the first frame deadline being now
+ *
+ * @param pacer pacer to initialize
+ * @return error code
+ */
+int pacer_init(pacer_t* pacer);
+
+
+/**
+ * @brief Restarts the schedule of a pacer from now (e.g. after a pause),
+ *        keeping its statistics
+ *
+ * @param pacer pacer to restart
+ * @return error code
+ */
+int pacer_restart(pacer_t* pacer);
+
+
+/**
+ * @brief Sleeps until the deadline of the next frame (59.7275 Hz), unless it is already passed.
+ *        In this case, returns at once the number of frames due so far, bounded by max_frames:
+ *        beyond, late frames are dropped and the schedule is rebased on now, so that a stall
+ *        does not snowball into ever longer catch-ups.
+ *
+ * @param pacer pacer to wait on
+ * @param max_frames maximal number of frames to catch up at once (at least 1)
+ * @param nb_frames (modified) number of frames to emulate now
+ * @return error code
+ */
+int pacer_wait(pacer_t* pacer, uint64_t max_frames, uint64_t* nb_frames);
+
+
+/**
+ * @brief Gives, without waiting, the number of frames to emulate on a refresh of the display.
+ *        When the refresh rate matches the Game Boy frame rate (see PACER_RATE_TOLERANCE),
+ *        exactly one frame per refresh, the schedule following the display. Otherwise, the
+ *        display is resampled: the frames due by now (none when the display is faster,
+ *        the frame shown being shown again), at most max_frames as in pacer_wait().
+ *
+ * @param pacer pacer to tick
+ * @param now time of the refresh (CLOCK_MONOTONIC, in ns)
+ * @param refresh refresh interval of the display (in ns), 0 if unknown
+ * @param max_frames maximal number of frames to catch up at once (at least 1)
+ * @param nb_frames (modified) number of frames to emulate now, possibly 0
+ * @return error code
+ */
+int pacer_tick(pacer_t* pacer, uint64_t now, uint64_t refresh, uint64_t max_frames, uint64_t* nb_frames);
+
+
+/**
+ * @brief Prints the jitter statistics of a pacer
+ *
+ * @param pacer pacer to print
+ * @param output stream to print to
+ * @return error code
+ */
+int pacer_print_stats(const pacer_t* pacer, FILE* output);
+
+#ifdef __cplusplus
+}
+#endif
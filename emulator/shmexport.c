@@ -0,0 +1,177 @@
+/**
+ * @file shmexport.c
+ * @brief Export of the frames to other local processes, through POSIX shared memory
+ *
+ * @author E. Wengle, E. Garandel, EPFL
+ * @date 2020
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>    // O_* constants
+#include <unistd.h>   // ftruncate, close
+#include <sys/mman.h> // shm_open, mmap
+
+#include "shmexport.h"
+#include "error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maps a shared-memory segment
+ * @param exp (modified) export mapped
+ * @param name name of the segment
+ * @param owner whether to create the segment (writable) or map an existing one (read-only)
+ * @return error code
+ */
+static int shmexport_attach(shmexport_t* exp, const char* name, int owner)
+{
+    memset(exp, 0, sizeof(shmexport_t));
+    exp->name = malloc(strlen(name) + 1);
+    if(exp->name == NULL) return ERR_MEM;
+    strcpy(exp->name, name);
+    exp->owner = owner;
+
+    const size_t size = sizeof(shmexport_segment_t);
+    const int fd = owner ? shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644) : shm_open(name, O_RDONLY, 0);
+    int err = fd < 0 ? ERR_IO : ERR_NONE;
+    if(err == ERR_NONE && owner && ftruncate(fd, (off_t) size) != 0){
+        err = ERR_IO;
+    }
+    if(err == ERR_NONE){
+        void* const segment = mmap(NULL, size, owner ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if(segment == MAP_FAILED){
+            err = ERR_IO;
+        } else {
+            exp->segment = segment;
+        }
+    }
+    if(fd >= 0) close(fd); // the mapping remains
+
+    if(err != ERR_NONE){
+        if(fd >= 0 && owner) shm_unlink(name);
+        free(exp->name);
+        exp->name = NULL;
+    }
+    return err;
+}
+
+// ==== see shmexport.h ========================================
+int shmexport_open(shmexport_t* exp, const char* name)
+{
+    M_REQUIRE_NON_NULL(exp);
+    M_REQUIRE_NON_NULL(name);
+
+    M_REQUIRE_NO_ERR(shmexport_attach(exp, name, 1));
+
+    // fresh segment, all zeros: no frame published yet (see shmexport_read_begin())
+    shmexport_segment_t* const s = exp->segment;
+    s->width = LCD_WIDTH;
+    s->height = LCD_HEIGHT;
+    s->version = SHMEXPORT_VERSION;
+    atomic_store_explicit(&(s->latest), 0, memory_order_relaxed);
+    for(size_t i = 0; i < SHMEXPORT_NB_BUFFERS; ++i){
+        atomic_store_explicit(&(s->buffers[i].seq), 0, memory_order_relaxed);
+    }
+    // consumers check the magic number last
+    atomic_thread_fence(memory_order_release);
+    s->magic = SHMEXPORT_MAGIC;
+    return ERR_NONE;
+}
+
+// ==== see shmexport.h ========================================
+int shmexport_publish(shmexport_t* exp, const uint8_t* pixels, uint64_t frame, const joypad_t* pad)
+{
+    M_REQUIRE_NON_NULL(exp);
+    M_REQUIRE_NON_NULL(exp->segment);
+    M_REQUIRE_NON_NULL(pixels);
+    M_REQUIRE_NON_NULL(pad);
+    M_REQUIRE(exp->owner, ERR_BAD_PARAMETER, "%s", "segment mapped read-only");
+
+    shmexport_segment_t* const s = exp->segment;
+    const unsigned next = (atomic_load_explicit(&(s->latest), memory_order_relaxed) + 1) % SHMEXPORT_NB_BUFFERS;
+    shmexport_buffer_t* const b = &(s->buffers[next]);
+
+    // odd while written: the writes of the frame are not visible before
+    const unsigned seq = atomic_load_explicit(&(b->seq), memory_order_relaxed);
+    atomic_store_explicit(&(b->seq), seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    b->frame = frame;
+    // key i of joypad_t is bit i % NB_GB_KEY_COLS of row i / NB_GB_KEY_COLS
+    b->keys = (uint8_t) ((pad->keys_state[0] & 0x0F) | (pad->keys_state[1] & 0x0F) << NB_GB_KEY_COLS);
+    memcpy(b->pixels, pixels, sizeof(b->pixels));
+
+    atomic_store_explicit(&(b->seq), seq + 2, memory_order_release);
+    atomic_store_explicit(&(s->latest), next, memory_order_release);
+    return ERR_NONE;
+}
+
+// ==== see shmexport.h ========================================
+int shmexport_map(shmexport_t* exp, const char* name)
+{
+    M_REQUIRE_NON_NULL(exp);
+    M_REQUIRE_NON_NULL(name);
+
+    M_REQUIRE_NO_ERR(shmexport_attach(exp, name, 0));
+
+    const shmexport_segment_t* const s = exp->segment;
+    if(s->magic != SHMEXPORT_MAGIC || s->version != SHMEXPORT_VERSION ||
+       s->width != LCD_WIDTH || s->height != LCD_HEIGHT){
+        shmexport_close(exp);
+        return ERR_IO;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return ERR_NONE;
+}
+
+// ==== see shmexport.h ========================================
+const shmexport_buffer_t* shmexport_read_begin(const shmexport_t* exp, unsigned* seq)
+{
+    if(exp == NULL || exp->segment == NULL || seq == NULL) return NULL;
+
+    const shmexport_segment_t* const s = exp->segment;
+    for(size_t tries = 0; tries < SHMEXPORT_READ_TRIES; ++tries){
+        const unsigned latest = atomic_load_explicit(&(s->latest), memory_order_acquire);
+        const shmexport_buffer_t* const b = &(s->buffers[latest % SHMEXPORT_NB_BUFFERS]);
+        *seq = atomic_load_explicit(&(b->seq), memory_order_acquire);
+        if(*seq == 0) return NULL; // nothing published yet
+        // otherwise rewritten already: the emulator went round the buffers since latest was read
+        if(!(*seq & 1)) return b;
+    }
+    // never completed (writer gone) or rewritten over and over: up to the caller to try again
+    return NULL;
+}
+
+// ==== see shmexport.h ========================================
+int shmexport_read_valid(const shmexport_buffer_t* buffer, unsigned seq)
+{
+    if(buffer == NULL) return 0;
+
+    // the reads of the frame are done before the sequence number is read again
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&(buffer->seq), memory_order_relaxed) == seq;
+}
+
+// ==== see shmexport.h ========================================
+int shmexport_close(shmexport_t* exp)
+{
+    M_REQUIRE_NON_NULL(exp);
+    M_REQUIRE_NON_NULL(exp->segment);
+
+    int err = munmap(exp->segment, sizeof(shmexport_segment_t)) == 0 ? ERR_NONE : ERR_IO;
+    if(exp->owner && shm_unlink(exp->name) != 0){
+        err = ERR_IO;
+    }
+    free(exp->name);
+    memset(exp, 0, sizeof(shmexport_t));
+    return err;
+}
+
+#ifdef __cplusplus
+}
+#endif
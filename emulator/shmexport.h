@@ -0,0 +1,133 @@
+#pragma once
+
+/**
+ * @file shmexport.h
+ * @brief Export of the frames to other local processes, through POSIX shared memory
+ *
+ * @author E. Wengle, E. Garandel, EPFL
+ * @date 2020
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "lcdc.h"   // LCD_WIDTH, LCD_HEIGHT
+#include "joypad.h" // joypad_t
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHMEXPORT_MAGIC   0x48534247 // "GBSH"
+#define SHMEXPORT_VERSION 1
+
+// frames in the segment: the one being written, and the two last published
+#define SHMEXPORT_NB_BUFFERS 3
+
+// times shmexport_read_begin() reads the latest frame again while it is being written, at most
+#define SHMEXPORT_READ_TRIES 1000
+
+/**
+ * @brief A frame of the segment, protected by a sequence lock:
+ *        its sequence number is odd while it is written, and increases once written
+ */
+typedef struct {
+    _Alignas(64) atomic_uint seq;
+    uint64_t frame;                        // number of frames emulated when published
+    uint8_t keys;                          // keys pressed, bit i for gb_key_t i
+    uint8_t pixels[LCD_HEIGHT][LCD_WIDTH]; // colors, 0 being white (see lcdc_framebuffer())
+} shmexport_buffer_t;
+
+/**
+ * @brief Layout of the shared-memory segment.
+ *        The buffers are written in turn, latest being the last one published:
+ *        a frame read is only overwritten two publications after its own.
+ */
+typedef struct {
+    uint32_t magic;   // SHMEXPORT_MAGIC
+    uint32_t version; // SHMEXPORT_VERSION
+    uint32_t width;   // LCD_WIDTH
+    uint32_t height;  // LCD_HEIGHT
+    atomic_uint latest;
+    shmexport_buffer_t buffers[SHMEXPORT_NB_BUFFERS];
+} shmexport_segment_t;
+
+/**
+ * @brief Shared-memory export type: the segment, mapped by the emulator (writable)
+ *        or by a consumer (read-only)
+ */
+typedef struct {
+    shmexport_segment_t* segment;
+    char* name;   // name of the segment, removed on close by the emulator
+    int owner;    // whether the segment was created here (see shmexport_open())
+} shmexport_t;
+
+
+/**
+ * @brief Creates a shared-memory segment (replacing any segment of the same name) to publish frames to
+ *
+ * @param exp export to open
+ * @param name name of the segment (see shm_open(), e.g. "/gameboy")
+ * @return error code
+ */
+int shmexport_open(shmexport_t* exp, const char* name);
+
+
+/**
+ * @brief Publishes a frame: writes it to the buffer after the latest, then makes it the latest.
+ *        Never waits on consumers.
+ *
+ * @param exp export to publish to (see shmexport_open())
+ * @param pixels frame, LCD_HEIGHT lines of LCD_WIDTH colors (see lcdc_framebuffer())
+ * @param frame number of frames emulated
+ * @param pad joypad, the keys pressed of which are published
+ * @return error code
+ */
+int shmexport_publish(shmexport_t* exp, const uint8_t* pixels, uint64_t frame, const joypad_t* pad);
+
+
+/**
+ * @brief Maps, read-only, the segment an emulator publishes frames to
+ *
+ * @param exp export to map
+ * @param name name of the segment
+ * @return error code (ERR_IO if there is no such segment, or not of this version)
+ */
+int shmexport_map(shmexport_t* exp, const char* name);
+
+
+/**
+ * @brief Starts reading the latest frame, in place: it is to be checked with
+ *        shmexport_read_valid() once read, and read again if overwritten meanwhile.
+ *        Never waits: gives up when the latest frame is still being written after
+ *        SHMEXPORT_READ_TRIES reads (e.g. the emulator was killed while publishing it),
+ *        retrying later being up to the caller.
+ *
+ * @param exp export mapped (see shmexport_map())
+ * @param seq (modified) sequence number of the frame, to be given to shmexport_read_valid()
+ * @return latest frame, NULL if none was published yet, if it is still being written, or on error
+ */
+const shmexport_buffer_t* shmexport_read_begin(const shmexport_t* exp, unsigned* seq);
+
+
+/**
+ * @brief Tells whether a frame read since shmexport_read_begin() was left untouched by the emulator
+ *
+ * @param buffer frame read
+ * @param seq sequence number given by shmexport_read_begin()
+ * @return whether what was read of the frame is consistent
+ */
+int shmexport_read_valid(const shmexport_buffer_t* buffer, unsigned seq);
+
+
+/**
+ * @brief Unmaps the segment, and removes it if created by shmexport_open()
+ *
+ * @param exp export to close
+ * @return error code
+ */
+int shmexport_close(shmexport_t* exp);
+
+#ifdef __cplusplus
+}
+#endif
@@ -8,31 +8,111 @@
 
 #include "sidlib.h"
 
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// ======================================================================
+static void add_overhead_(simple_image_displayer_t* psd, gint64 overhead)
+{
+    psd->overhead_sum += overhead;
+    if (overhead > psd->overhead_max) psd->overhead_max = overhead;
+}
+
+// ======================================================================
+static void copy_to_surface_(simple_image_displayer_t* psd)
+{
+    cairo_surface_flush(psd->surface);
+    guchar* const data = cairo_image_surface_get_data(psd->surface);
+    const int stride = cairo_image_surface_get_stride(psd->surface);
+    for (int r = psd->dirty_first; r < psd->dirty_end; r++) {
+        const guchar* src = psd->pixels + (size_t) (3 * psd->width * r);
+        uint32_t* const dst = (uint32_t*) (data + (size_t) (stride * r));
+        for (int c = 0; c < psd->width; c++, src += 3) {
+            dst[c] = (uint32_t) src[0] << 16 | (uint32_t) src[1] << 8 | src[2]; // CAIRO_FORMAT_RGB24
+        }
+    }
+    cairo_surface_mark_dirty_rectangle(psd->surface, 0, psd->dirty_first, psd->width, psd->dirty_end - psd->dirty_first);
+}
+
 // ======================================================================
 static int update_(gpointer data)
 {
     simple_image_displayer_t* const psd = data;
 
-    GdkPixbuf* pb = gtk_image_get_pixbuf(GTK_IMAGE(psd->image));
-    // gdk_pixbuf_fill(pb, 0); // clear to black
-
-    guchar* pixels = gdk_pixbuf_get_pixels(pb);
-    psd->gen(pixels, psd->height, psd->width);
-    gtk_image_set_from_pixbuf(GTK_IMAGE(psd->image),
-                              gdk_pixbuf_new_from_data(
-                              pixels,
-                              GDK_COLORSPACE_RGB,      // colorspace
-                              0,                       // has_alpha (no alpha)
-                              8,                       // bits-per-sample (must be 8)
-                              psd->width, psd->height, // cols, rows
-                              3*psd->width,            // rowstride
-                              NULL, NULL               // nothing to free yet
-                              )
-                             );
+    // the generator writes in place into the same image, frame after frame
+    psd->dirty_first = 0;
+    psd->dirty_end = psd->height;
+    psd->gen(psd->pixels, psd->height, psd->width);
+
+    // only the rows changed are presented again
+    const gint64 start = g_get_monotonic_time();
+    if (psd->dirty_first < psd->dirty_end) {
+        copy_to_surface_(psd);
+        gtk_widget_queue_draw_area(psd->image, 0, psd->dirty_first, psd->width, psd->dirty_end - psd->dirty_first);
+    }
+    add_overhead_(psd, g_get_monotonic_time() - start);
+    ++psd->nb_frames;
 
     return 1; // continue timer
 }
 
+// ======================================================================
+void sd_set_dirty_rows(simple_image_displayer_t* p_sd, int first, int end)
+{
+    if (p_sd == NULL) return;
+    p_sd->dirty_first = first < 0 ? 0 : first;
+    p_sd->dirty_end = end > p_sd->height ? p_sd->height : end;
+    if (p_sd->dirty_end < p_sd->dirty_first) p_sd->dirty_end = p_sd->dirty_first;
+}
+
+// ======================================================================
+static gboolean draw_(GtkWidget* widget __attribute__((unused)), cairo_t* cr, gpointer data)
+{
+    simple_image_displayer_t* const psd = data;
+
+    const gint64 start = g_get_monotonic_time();
+    cairo_set_source_surface(cr, psd->surface, 0, 0);
+    cairo_paint(cr);
+    add_overhead_(psd, g_get_monotonic_time() - start);
+
+    return TRUE;
+}
+
+// ======================================================================
+static gboolean tick_(GtkWidget* widget __attribute__((unused)), GdkFrameClock* clock, gpointer data)
+{
+    simple_image_displayer_t* const psd = data;
+
+    psd->frame_time = gdk_frame_clock_get_frame_time(clock);
+    gint64 presentation_time = 0;
+    gdk_frame_clock_get_refresh_info(clock, psd->frame_time, &(psd->refresh_interval), &presentation_time);
+    (void)update_(data);
+
+    return G_SOURCE_CONTINUE;
+}
+
+// ======================================================================
+static void start_updates_(simple_image_displayer_t* psd)
+{
+    if (psd->time == SD_FRAME_CLOCK) {
+        psd->timeout_id = gtk_widget_add_tick_callback(psd->image, tick_, psd, NULL);
+    } else {
+        psd->timeout_id = g_timeout_add(psd->time, update_, psd);
+    }
+}
+
+// ======================================================================
+static void stop_updates_(simple_image_displayer_t* psd)
+{
+    if (psd->time == SD_FRAME_CLOCK) {
+        gtk_widget_remove_tick_callback(psd->image, psd->timeout_id);
+    } else {
+        g_source_remove(psd->timeout_id);
+    }
+    psd->timeout_id = 0;
+}
+
 // ======================================================================
 simple_image_displayer_t* sd_init(const char* title, int width, int height, guint time,
                                   ds_image_generator generator,
@@ -47,24 +127,18 @@ simple_image_displayer_t* sd_init(const char* title, int width, int height, guin
         output->keys_r = key_r_handler;
         output->time = time;
         output->timeout_id = 0;
+        output->frame_time = 0;
+        output->refresh_interval = 0;
         output->title = title;
         output->image = NULL;
+        output->pixels = NULL;
+        output->surface = NULL;
+        output->dirty_first = 0;
+        output->dirty_end = height;
     }
     return output;
 }
 
-// ======================================================================
-static GBytes* bw_to_rgb(const guchar* bw, guint size)
-{
-    GByteArray* rgb = g_byte_array_sized_new(3 * size);
-    if (rgb != NULL) {
-        for (size_t i = 0; i < size; i++)
-            for (size_t j = 0; j < 3; j++)
-                g_byte_array_append(rgb, bw + i, 1);
-    }
-    return g_byte_array_free_to_bytes(rgb);
-}
-
 // ======================================================================
 gboolean ds_simple_key_handler(guint keyval, gpointer data)
 {
@@ -74,12 +148,11 @@ gboolean ds_simple_key_handler(guint keyval, gpointer data)
     case GDK_KEY_space:
         if (psd->timeout_id > 0) {
             // pause update
-            g_source_remove(psd->timeout_id);
-            psd->timeout_id = 0;
+            stop_updates_(psd);
         } else {
             // relaunch update
             if ((psd->time > 0) && (psd->gen != NULL)) {
-                psd->timeout_id = g_timeout_add(psd->time, update_, data);
+                start_updates_(psd);
             }
         }
         return TRUE;
@@ -114,8 +187,16 @@ static gboolean keyrelease_handler_(GtkWidget* widget __attribute__((unused)),
 void sd_launch(int* p_argc, char*** p_argv, simple_image_displayer_t* p_sd)
 {
     if (p_sd != NULL) {
-        // initial image all black
-        guchar* bw = calloc((size_t) p_sd->width * sizeof(guchar), (size_t) p_sd->height);
+        // initial image all black; both the image and the surface are kept for the whole run
+        p_sd->pixels = calloc((size_t) (3 * p_sd->width), (size_t) p_sd->height);
+        p_sd->surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, p_sd->width, p_sd->height);
+        if (p_sd->pixels == NULL || cairo_surface_status(p_sd->surface) != CAIRO_STATUS_SUCCESS) {
+            fputs("sidlib: cannot allocate the image\n", stderr);
+            cairo_surface_destroy(p_sd->surface);
+            free(p_sd->pixels);
+            free(p_sd);
+            return;
+        }
 
         gtk_init(p_argc, p_argv);
         GtkWidget* window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -123,16 +204,9 @@ void sd_launch(int* p_argc, char*** p_argv, simple_image_displayer_t* p_sd)
         gtk_window_set_default_size(GTK_WINDOW(window), p_sd->width + 20, p_sd->height + 20);
         gtk_window_set_position(GTK_WINDOW(window), GTK_WIN_POS_CENTER);
 
-        p_sd->image = gtk_image_new_from_pixbuf(
-                      gdk_pixbuf_new_from_bytes(
-                      bw_to_rgb(bw, (guint) (p_sd->height * p_sd->width)),
-                      GDK_COLORSPACE_RGB,        // colorspace
-                      0,                         // has_alpha (no alpha)
-                      8,                         // bits-per-sample (must be 8)
-                      p_sd->width, p_sd->height, // cols, rows
-                      3*p_sd->width              // rowstride
-                      )
-                      );
+        p_sd->image = gtk_drawing_area_new();
+        gtk_widget_set_size_request(p_sd->image, p_sd->width, p_sd->height);
+        g_signal_connect(p_sd->image, "draw", G_CALLBACK(draw_), p_sd);
         gtk_container_add(GTK_CONTAINER(window), p_sd->image);
 
         // quit function
@@ -140,7 +214,7 @@ void sd_launch(int* p_argc, char*** p_argv, simple_image_displayer_t* p_sd)
 
         if ((p_sd->time > 0) && (p_sd->gen != NULL)) {
             // set update function
-            p_sd->timeout_id = g_timeout_add(p_sd->time, update_, p_sd);
+            start_updates_(p_sd);
         } else if (p_sd->gen != NULL) {
             // call update function only once
             (void)update_(p_sd);
@@ -156,6 +230,15 @@ void sd_launch(int* p_argc, char*** p_argv, simple_image_displayer_t* p_sd)
 
         gtk_widget_show_all(window);
         gtk_main();
+
+        if (p_sd->nb_frames > 0) {
+            fprintf(stderr, "sidlib: %llu frames, presentation overhead: %.1f us per frame, longest step %lld us\n",
+                    (unsigned long long) p_sd->nb_frames,
+                    (double) p_sd->overhead_sum / (double) p_sd->nb_frames,
+                    (long long) p_sd->overhead_max);
+        }
+        cairo_surface_destroy(p_sd->surface);
+        free(p_sd->pixels);
         free(p_sd);
     }
 }
@@ -14,6 +14,10 @@
 extern "C" {
 #endif
 
+// refresh time for which the image is refreshed on every frame of the display
+// (GTK frame clock), instead of on a timeout
+#define SD_FRAME_CLOCK G_MAXUINT
+
 /**
  * @brief image generator function type
  */
@@ -37,9 +41,19 @@ typedef struct {
     ds_key_handler keys_r; // key release
     unsigned char key_status; // 8 bits for key status (use as you may need)
     guint time;
-    guint timeout_id;
+    guint timeout_id;          // timeout, or tick callback with SD_FRAME_CLOCK
+    gint64 frame_time;         // time of the frame of the display being drawn (in us, monotonic), 0 without frame clock
+    gint64 refresh_interval;   // refresh interval of the display (in us), 0 if unknown
     const char* title;
-    GtkWidget* image;
+    GtkWidget* image;          // drawing area the image is shown in
+    guchar* pixels;            // RGB image the generator writes into, 3*width bytes per line
+    cairo_surface_t* surface;  // image as drawn, updated in place from pixels
+    int dirty_first;           // rows dirty_first to dirty_end (excluded) changed (see sd_set_dirty_rows())
+    int dirty_end;
+    // presentation overhead (besides the generator), in microseconds
+    guint64 nb_frames;
+    gint64 overhead_sum;
+    gint64 overhead_max;
 } simple_image_displayer_t;
 
 
@@ -49,7 +63,8 @@ typedef struct {
  * @param title title of the window
  * @param width width of the image(s) to be displayed
  * @param height height of the image(s) to be displayed
- * @param time timelaps between two image refresh (in milliseconds); if 0, no refresh at all
+ * @param time timelaps between two image refresh (in milliseconds); if 0, no refresh at all;
+ *        if SD_FRAME_CLOCK, on every frame of the display
  * @param generator image generating function (will be called each `time` milliseconds); if 0, no refresh at all
  * @param key_p_handler a key handling function used on key-press event; if NULL, ds_simple_key_handler() is used
  * @param key_r_handler a key handling functionused on key-release event
@@ -61,7 +76,20 @@ simple_image_displayer_t* sd_init(const char* title, int width, int height, guin
 
 
 /**
- * @brief Run a Simple Image Displayer
+ * @brief To be called by the image generator when only some rows of the image changed
+ *        (all of them otherwise): only they are copied and drawn again, and nothing
+ *        at all when none changed (first == end)
+ *
+ * @param p_sd a pointer to the Simple Image Displayer
+ * @param first first row changed
+ * @param end last row changed (excluded)
+ */
+void sd_set_dirty_rows(simple_image_displayer_t* p_sd, int first, int end);
+
+
+/**
+ * @brief Run a Simple Image Displayer, then print its presentation overhead per frame
+ *        (on stderr) and free it
  *
  * @param p_argc a pointer to main argc
  * @param p_argv a pointer to main argv
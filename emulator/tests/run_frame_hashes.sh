@@ -0,0 +1,122 @@
+#!/bin/sh
+
+# Runs ROMs headlessly and compares the hash of each frame (screen and work RAM)
+# to the golden sequences of tests/data/frame_hashes, the ROMs being run in parallel.
+#
+# usage: run_frame_hashes.sh [--update] [gbheadless options]
+#   --update: (re)writes the golden sequences instead of comparing to them
+#   gbheadless options are passed on, e.g. -p to check the rendering pipeline,
+#   or -t 4 to check the rendering on several threads
+
+prog="$(basename "$0")"
+temp=/tmp/"${prog}-$$"
+
+trap 'err=$?;/bin/rm -rf "${temp}" >/dev/null 2>&1; exit $err' 0 1 2 3 15
+
+# ======================================================================
+esc="\033["
+end="${esc}0m"
+red="${esc}31m"
+green="${esc}32m"
+
+# ======================================================================
+# reports messages to stderr and exists
+error () {
+    echo $@ 1>&2
+    exit 1
+}
+
+# ======================================================================
+rootdir="$(realpath "$(dirname "$(realpath "$0")")/..")"
+exec="${rootdir}/gbheadless"
+[ -x "${exec}" ] || error "Cannot find \"${exec}\""
+
+datadir="${rootdir}/tests/data"
+goldendir="${datadir}/frame_hashes"
+[ -d "${goldendir}" ] || error "Cannot find \"${goldendir}\" subdirectory"
+
+update=
+if [ "x$1" = 'x--update' ]; then
+    update=yes
+    shift
+fi
+
+jobs="$(nproc 2>/dev/null || echo 1)"
+mkdir -p "${temp}" || error "Cannot create \"${temp}\""
+
+# ======================================================================
+# ROM (relative to tests/data):number of frames, as long as each test runs in run_blargg.sh
+roms="
+blargg_roms/01-special.gb:285
+blargg_roms/02-interrupts.gb:285
+blargg_roms/03-op sp,hl.gb:285
+blargg_roms/04-op r,imm.gb:399
+blargg_roms/05-op rp.gb:399
+blargg_roms/06-ld r,r.gb:285
+blargg_roms/07-jr,jp,call,ret,rst.gb:228
+blargg_roms/08-misc instrs.gb:285
+blargg_roms/09-op r,r.gb:854
+blargg_roms/10-bit ops.gb:1139
+blargg_roms/11-op a,(hl).gb:1424
+blargg_roms/instr_timing.gb:285
+fibonacci.gb:300
+"
+
+# runs one ROM, its hashes being written to ${temp}/<n>.hashes, its status to ${temp}/<n>.status
+run_one () {
+    n="$1"
+    gb_file="$(echo "$2" | cut -d: -f1)"
+    frames="$(echo "$2" | cut -d: -f2)"
+    shift 2
+    "$exec" "${datadir}/${gb_file}" -f "$frames" -w -H "${temp}/$n.hashes" "$@" > /dev/null 2> "${temp}/$n.stderr"
+    echo $? > "${temp}/$n.status"
+}
+
+# launches the ROMs, at most ${jobs} at once
+IFS='
+'
+n=0
+running=0
+for item in $roms; do
+    n=$((n + 1))
+    (IFS=' '; run_one $n "$item" "$@") &
+    running=$((running + 1))
+    if [ $running -ge "$jobs" ]; then
+        wait
+        running=0
+    fi
+done
+wait
+unset IFS
+
+# ======================================================================
+# reports the results, in order
+failed=0
+n=0
+IFS='
+'
+for item in $roms; do
+    unset IFS
+    n=$((n + 1))
+    gb_file="$(echo "$item" | cut -d: -f1)"
+    golden="${goldendir}/$(basename "$gb_file" .gb).hashes"
+    printf "${gb_file}: "
+    if [ "x$(cat "${temp}/$n.status")" != 'x0' ]; then
+        echo "${red}FAILED${end}: run failed"
+        cat "${temp}/$n.stderr"
+        failed=$((failed + 1))
+    elif [ -n "$update" ]; then
+        cp "${temp}/$n.hashes" "$golden" && echo "updated."
+    elif [ ! -r "$golden" ]; then
+        echo "${red}FAILED${end}: no golden sequence \"$golden\" (see --update)"
+        failed=$((failed + 1))
+    elif cmp -s "${temp}/$n.hashes" "$golden"; then
+        echo "${green}PASSED${end}."
+    else
+        echo "${red}FAILED${end}: first frame differing:"
+        diff "$golden" "${temp}/$n.hashes" | grep '^[<>]' | head -2
+        failed=$((failed + 1))
+    fi
+done
+
+[ $failed -eq 0 ] || error "$failed ROM(s) failed"
@@ -40,6 +40,25 @@ bit_t timer_state(gbtimer_t* timer);
  */
 int timer_incr_if_state_change(gbtimer_t* timer, bit_t old_state);
 
+/**
+ * @brief Increases timer by a given number of ticks (handling overflows)
+ *
+ * @param timer timer to increase
+ * @param ticks number of increments of TIMA
+ * @return error code
+ */
+int timer_incr(gbtimer_t* timer, uint64_t ticks);
+
+// TAC bit enabling the timer
+#define TAC_ENABLE_BIT 2
+
+// number of TIMA increments before it overflows from 0
+#define TIMA_OVERFLOW 0x100
+
+// index of the counter bit selected by TAC, TIMA is incremented on its falling edges
+#define tac_selected_bit(tac) \
+    (((tac) & 0x3) == 0 ? 9 : 2 * ((tac) & 0x3) + 1)
+
 
 
 // ==== see timer.h ========================================
@@ -49,6 +68,7 @@ int timer_init(gbtimer_t* timer, cpu_t* cpu){
     
     timer->cpu = cpu;
     timer->counter = 0;
+    timer->cycles = 0;
 
     return ERR_NONE;
 }
@@ -62,6 +82,7 @@ int timer_cycle(gbtimer_t* timer){
 
     bit_t old_state = timer_state(timer);
     timer->counter += GB_TICS_PER_CYCLE;
+    timer->cycles++;
     uint8_t msb = msb8(timer->counter);
 
     M_REQUIRE_NO_ERR(cpu_write_at_idx(timer->cpu, REG_DIV, msb));
@@ -70,6 +91,51 @@ int timer_cycle(gbtimer_t* timer){
 }
 
 
+// ==== see timer.h ========================================
+int timer_catch_up(gbtimer_t* timer, uint64_t target_cycle){
+    M_REQUIRE_NON_NULL(timer);
+    M_REQUIRE_NON_NULL(timer->cpu);
+
+    if(target_cycle <= timer->cycles)
+        return ERR_NONE;
+
+    const uint64_t from = timer->counter;
+    const uint64_t to = from + GB_TICS_PER_CYCLE * (target_cycle - timer->cycles);
+    const data_t tac = cpu_read_at_idx(timer->cpu, REG_TAC);
+
+    timer->counter = (uint16_t) to;
+    timer->cycles = target_cycle;
+    M_REQUIRE_NO_ERR(cpu_write_at_idx(timer->cpu, REG_DIV, msb8(timer->counter)));
+
+    if(bit_get(tac, TAC_ENABLE_BIT)){
+        // one falling edge of the selected bit each time the counter crosses a multiple of twice its weight
+        const int shift = tac_selected_bit(tac) + 1;
+        M_REQUIRE_NO_ERR(timer_incr(timer, (to >> shift) - (from >> shift)));
+    }
+    return ERR_NONE;
+}
+
+
+// ==== see timer.h ========================================
+uint64_t timer_next_event(const gbtimer_t* timer){
+    if(timer == NULL || timer->cpu == NULL)
+        return UINT64_MAX;
+
+    const data_t tac = cpu_read_at_idx(timer->cpu, REG_TAC);
+    if(!bit_get(tac, TAC_ENABLE_BIT))
+        return UINT64_MAX;
+
+    const int shift = tac_selected_bit(tac) + 1;
+    const uint64_t ticks = TIMA_OVERFLOW - cpu_read_at_idx(timer->cpu, REG_TIMA);
+
+    // counter value at which the overflowing falling edge occurs, and cycles needed to reach it
+    const uint64_t edge = (((uint64_t) timer->counter >> shift) + ticks) << shift;
+    const uint64_t nb_cycles = (edge - timer->counter + GB_TICS_PER_CYCLE - 1) / GB_TICS_PER_CYCLE;
+
+    return timer->cycles + nb_cycles - 1;
+}
+
+
 // ==== tool method ========================================
 bit_t timer_state(gbtimer_t* timer){
     M_REQUIRE_NON_NULL(timer);
@@ -83,7 +149,7 @@ bit_t timer_state(gbtimer_t* timer){
     switch(two_lsb){
         case 0: return TAC_bit & bit_get(msb8(timer->counter), 1);
         default:
-                return TAC_bit & bit_get(timer->counter, 2 * two_lsb + 1);
+                return TAC_bit & bit_get(timer->counter, tac_selected_bit(two_lsb));
     }
 }
 
@@ -123,6 +189,28 @@ int timer_incr_if_state_change(gbtimer_t* timer, bit_t old_state){
     return ERR_NONE;
 }
 
+// ==== tool method ========================================
+int timer_incr(gbtimer_t* timer, uint64_t ticks){
+    M_REQUIRE_NON_NULL(timer);
+    M_REQUIRE_NON_NULL(timer->cpu);
+
+    if(ticks == 0)
+        return ERR_NONE;
+
+    const data_t tima = cpu_read_at_idx(timer->cpu, REG_TIMA);
+    if(ticks < TIMA_OVERFLOW - tima){
+        return cpu_write_at_idx(timer->cpu, REG_TIMA, (data_t) (tima + ticks));
+    }
+
+    // TIMA overflows (possibly several times) and then counts from TMA
+    const data_t tma = cpu_read_at_idx(timer->cpu, REG_TMA);
+    ticks -= TIMA_OVERFLOW - tima;
+    M_REQUIRE_NO_ERR(cpu_write_at_idx(timer->cpu, REG_TIMA, (data_t) (tma + ticks % (TIMA_OVERFLOW - tma))));
+    cpu_request_interrupt(timer->cpu, TIMER);
+
+    return ERR_NONE;
+}
+
 #ifdef __cplusplus
 }
 #endif
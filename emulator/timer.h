@@ -36,6 +36,7 @@ extern "C" {
  typedef struct{
     cpu_t* cpu;
     uint16_t counter;
+    uint64_t cycles; // number of cycles already simulated
 
  }gbtimer_t;
 
@@ -58,6 +59,27 @@ int timer_init(gbtimer_t* timer, cpu_t* cpu);
 int timer_cycle(gbtimer_t* timer);
 
 
+/**
+ * @brief Brings a timer up to date, i.e. simulates it for all the cycles
+ *        before target_cycle at once (same result as as many timer_cycle())
+ *
+ * @param timer timer to catch up
+ * @param target_cycle first cycle not to simulate
+ * @return error code
+ */
+int timer_catch_up(gbtimer_t* timer, uint64_t target_cycle);
+
+
+/**
+ * @brief Computes the next cycle at which the timer will raise an interrupt
+ *        (as long as its registers are not written to)
+ *
+ * @param timer timer to check
+ * @return cycle of the next TIMA overflow, UINT64_MAX if the timer is stopped
+ */
+uint64_t timer_next_event(const gbtimer_t* timer);
+
+
 /**
  * @brief Timer bus listening handler
  *
@@ -899,6 +899,205 @@ START_TEST(bit_vector_deadboss)
 }
 END_TEST
 
+#define BULK_MAX_SIZE 600
+
+static uint32_t random_word(void)
+{
+    return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
+
+static bit_vector_t* random_vector(size_t size)
+{
+    bit_vector_t* pbv = bit_vector_create(size, 0);
+    ck_assert_ptr_nonnull(pbv);
+    for (size_t i = 0; i < pbv->nb_fields; ++i) {
+        pbv->content[i] = random_word();
+    }
+    // keep the unused bits of the last word cleared
+    bit_vector_t* ones = bit_vector_create(size, 1);
+    bit_vector_and(pbv, ones);
+    bit_vector_free(&ones);
+    return pbv;
+}
+
+START_TEST(bit_vector_bulk_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    ck_assert_ptr_null(bit_vector_andnot(NULL, NULL));
+    ck_assert_ptr_null(bit_vector_or_and(NULL, NULL, NULL));
+    ck_assert_ptr_null(bit_vector_blend(NULL, NULL, NULL, NULL));
+    ck_assert_bad_param(bit_vector_set_isa(BIT_VECTOR_ISA_COUNT));
+
+    const bit_vector_isa_t selected = bit_vector_isa();
+
+    // every supported instruction set against a word by word model
+    for (bit_vector_isa_t isa = BIT_VECTOR_ISA_SCALAR; isa < BIT_VECTOR_ISA_COUNT; ++isa) {
+        if (bit_vector_set_isa(isa) != ERR_NONE) continue;
+        ck_assert_int_eq(bit_vector_isa(), isa);
+
+        for (size_t size = 1; size <= BULK_MAX_SIZE; size += 1 + (size_t) rand() % 13) {
+            bit_vector_t* a = random_vector(size);
+            bit_vector_t* b = random_vector(size);
+            bit_vector_t* c = random_vector(size);
+            bit_vector_t* r = bit_vector_cpy(a);
+            const size_t tail = size % IMAGE_LINE_WORD_BITS;
+            const uint32_t last = tail == 0 ? UINT32_MAX : (UINT32_C(1) << tail) - 1;
+
+#define check_bulk(call, expected) \
+            do { \
+                ck_assert_ptr_eq(call, r); \
+                for (size_t i = 0; i < r->nb_fields; ++i) { \
+                    const uint32_t mask = i + 1 == r->nb_fields ? last : UINT32_MAX; \
+                    ck_assert_uint_eq(r->content[i], (expected) & mask); \
+                } \
+                bit_vector_cpy_into(r, a); \
+            } while (0)
+
+            check_bulk(bit_vector_not(r), ~a->content[i]);
+            check_bulk(bit_vector_and(r, b), a->content[i] & b->content[i]);
+            check_bulk(bit_vector_or(r, b), a->content[i] | b->content[i]);
+            check_bulk(bit_vector_xor(r, b), a->content[i] ^ b->content[i]);
+            check_bulk(bit_vector_andnot(r, b), a->content[i] & ~b->content[i]);
+            check_bulk(bit_vector_or_and(r, b, c), a->content[i] | (b->content[i] & c->content[i]));
+            check_bulk(bit_vector_blend(r, b, c, a),
+                       (b->content[i] & ~a->content[i]) | (c->content[i] & a->content[i]));
+#undef check_bulk
+
+            bit_vector_free(&a);
+            bit_vector_free(&b);
+            bit_vector_free(&c);
+            bit_vector_free(&r);
+        }
+    }
+
+    ck_assert_err_none(bit_vector_set_isa(selected));
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
+#define DIFF_ROUNDS 2000
+#define DIFF_MAX_SIZE 300
+
+// reference model: bit i of the result, computed bit by bit
+static bit_t model_zero(const bit_vector_t* pbv, int64_t index, size_t i)
+{
+    const int64_t j = index + (int64_t) i;
+    return j >= 0 && j < (int64_t) pbv->size ? bit_vector_get(pbv, (size_t) j) : 0;
+}
+
+static bit_t model_wrap(const bit_vector_t* pbv, int64_t index, size_t i)
+{
+    int64_t j = (index + (int64_t) i) % (int64_t) pbv->size;
+    if (j < 0) j += (int64_t) pbv->size;
+    return bit_vector_get(pbv, (size_t) j);
+}
+
+#define vector_match_model(vec, model) \
+    do { \
+        ck_assert_ptr_nonnull(vec); \
+        for (size_t i = 0; i < (vec)->size; ++i) { \
+            ck_assert_msg(bit_vector_get(vec, i) == (model), \
+                          "bit %zu differs (size %zu, index %" PRId64 ")", i, (vec)->size, index); \
+        } \
+        for (size_t i = (vec)->size; i < (vec)->nb_fields * IMAGE_LINE_WORD_BITS; ++i) { \
+            ck_assert(((vec)->content[i / IMAGE_LINE_WORD_BITS] >> (i % IMAGE_LINE_WORD_BITS) & 1) == 0); \
+        } \
+    } while (0)
+
+START_TEST(bit_vector_extract_differential)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    for (size_t round = 0; round < DIFF_ROUNDS; ++round) {
+        const size_t size = 1 + (size_t) rand() % DIFF_MAX_SIZE;
+        const size_t out_size = 1 + (size_t) rand() % DIFF_MAX_SIZE;
+        const int64_t index = (int64_t) (rand() % (4 * DIFF_MAX_SIZE)) - 2 * DIFF_MAX_SIZE;
+        bit_vector_t* a = random_vector(size);
+        bit_vector_t* b = random_vector(size);
+
+        bit_vector_t* zero = bit_vector_extract_zero_ext(a, index, out_size);
+        vector_match_model(zero, model_zero(a, index, i));
+
+        bit_vector_t* wrap = bit_vector_extract_wrap_ext(a, index, out_size);
+        vector_match_model(wrap, model_wrap(a, index, i));
+
+        bit_vector_t* shift = bit_vector_shift(a, index);
+        vector_match_model(shift, model_zero(a, -index, i));
+
+        const int64_t start = (int64_t) ((size_t) rand() % (size + 1));
+        bit_vector_t* join = bit_vector_join(a, b, start);
+        vector_match_model(join, bit_vector_get((int64_t) i < start ? a : b, i));
+
+        bit_vector_free(&a);
+        bit_vector_free(&b);
+        bit_vector_free(&zero);
+        bit_vector_free(&wrap);
+        bit_vector_free(&shift);
+        bit_vector_free(&join);
+    }
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
+START_TEST(bit_vector_inline_storage)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    ck_assert_ptr_null(bit_vector_init(NULL, 1, 0));
+
+    bit_vector_t small;
+    ck_assert_ptr_null(bit_vector_init(&small, 0, 0));
+    ck_assert_ptr_eq(bit_vector_init(&small, BIT_VECTOR_INLINE_BITS, 1), &small);
+    ck_assert_ptr_eq(small.content, small.inline_content);
+    for (size_t i = 0; i < small.size; ++i)
+        ck_assert_int_eq(bit_vector_get(&small, i), 1);
+
+    bit_vector_t big;
+    ck_assert_ptr_eq(bit_vector_init(&big, BIT_VECTOR_INLINE_BITS + 1, 0), &big);
+    ck_assert_ptr_ne(big.content, big.inline_content);
+
+    bit_vector_t* heap = bit_vector_create(40, 1);
+    ck_assert_ptr_eq(heap->content, heap->inline_content);
+    bit_vector_free(&heap);
+
+    // stack and heap vectors mix freely
+    for (size_t round = 0; round < 100; ++round) {
+        const size_t size = 1 + (size_t) rand() % (2 * BIT_VECTOR_INLINE_BITS);
+        bit_vector_t* a = random_vector(size);
+        bit_vector_t local;
+        ck_assert_ptr_eq(bit_vector_init(&local, size, 0), &local);
+        ck_assert_ptr_eq(bit_vector_cpy_into(&local, a), &local);
+        bit_vector_xor(&local, a);
+        for (size_t i = 0; i < size; ++i)
+            ck_assert_int_eq(bit_vector_get(&local, i), 0);
+        bit_vector_release(&local);
+        ck_assert_ptr_null(local.content);
+        bit_vector_free(&a);
+    }
+
+    bit_vector_release(&small);
+    bit_vector_release(&big);
+    bit_vector_release(NULL);
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
 Suite* cartridge_test_suite()
 {
 
@@ -924,6 +1123,9 @@ Suite* cartridge_test_suite()
     tcase_add_test(tc1, bit_vector_join_exec);
     tcase_add_test(tc1, bit_vector_various);
     tcase_add_test(tc1, bit_vector_deadboss);
+    tcase_add_test(tc1, bit_vector_bulk_exec);
+    tcase_add_test(tc1, bit_vector_extract_differential);
+    tcase_add_test(tc1, bit_vector_inline_storage);
 
     return s;
 }
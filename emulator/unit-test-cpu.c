@@ -531,6 +531,62 @@ START_TEST(test_cpu_cycle_exec)
 END_TEST
 
 
+START_TEST(test_cpu_interrupt_exec)
+{
+    // ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    size_t size = 255;
+    add_bus(cpu, size);
+    cpu.SP = 0x80;
+    cpu.IME = 1;
+
+    // requested but not enabled: not pending
+    cpu_request_interrupt(&cpu, TIMER);
+    ck_assert_int_eq(cpu.pending, 0);
+    ck_assert_int_eq(cpu_cycle(&cpu), ERR_NONE);
+    ck_assert_int_eq(cpu.PC, 1);
+
+    // enabling through the bus updates the pending interrupts
+    ck_assert_int_eq(cpu_write_at_idx(&cpu, REG_IE, 0xFF), ERR_NONE);
+    ck_assert_int_eq(cpu.pending, 1 << TIMER);
+
+    // the lowest pending interrupt is handled first
+    cpu_request_interrupt(&cpu, SERIAL);
+    cpu_request_interrupt(&cpu, LCD_STAT);
+    ck_assert_int_eq(cpu.pending, (1 << TIMER) | (1 << SERIAL) | (1 << LCD_STAT));
+    ck_assert_int_eq(cpu_cycle(&cpu), ERR_NONE);
+    ck_assert_int_eq(cpu.PC, 0x48); // LCD_STAT handler
+    ck_assert_int_eq(cpu.IF, (1 << TIMER) | (1 << SERIAL));
+    ck_assert_int_eq(cpu.pending, (1 << TIMER) | (1 << SERIAL));
+
+    // clearing IF through the bus clears the pending interrupts
+    ck_assert_int_eq(cpu_write_at_idx(&cpu, REG_IF, 0), ERR_NONE);
+    ck_assert_int_eq(cpu.pending, 0);
+
+    // a halted cpu stays idle until an interrupt is pending
+    cpu.idle_time = 0;
+    cpu.IME = 0;
+    cpu.HALT = 1;
+    const uint16_t pc = cpu.PC;
+    ck_assert_int_eq(cpu_cycle(&cpu), ERR_NONE);
+    ck_assert_int_eq(cpu.HALT, 1);
+    ck_assert_int_eq(cpu.PC, pc);
+
+    cpu_request_interrupt(&cpu, JOYPAD);
+    ck_assert_int_eq(cpu.pending, 1 << JOYPAD);
+    ck_assert_int_eq(cpu_cycle(&cpu), ERR_NONE);
+    ck_assert_int_eq(cpu.HALT, 0);
+
+    finish();
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
 Suite* cpu_test_suite()
 {
 
@@ -569,6 +625,7 @@ Suite* cpu_test_suite()
     Add_Case(s, tc5, "Cpu Cycle Tests");
     tcase_add_test(tc5, test_cpu_cycle_err);
     tcase_add_test(tc5, test_cpu_cycle_exec);
+    tcase_add_test(tc5, test_cpu_interrupt_exec);
 
     return s;
 }
@@ -0,0 +1,302 @@
+/**
+ * @file unit-test-framesink.c
+ * @brief Unit test code for the streaming of frames
+ *
+ * @author E. Wengle, E. Garandel, EPFL
+ * @date 2020
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h> // mkstemp, close, unlink, pipe, read
+#include <check.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h> // nanosleep
+
+#include "util.h"
+#include "tests.h"
+#include "framesink.h"
+#include "lcdc.h"
+#include "error.h"
+
+#define FRAME_SIZE (LCD_HEIGHT * LCD_WIDTH)
+#define PPM_HEADER "P6\n160 144\n255\n"
+#define Y4M_HEADER "YUV4MPEG2 W160 H144 F1048576:17556 Ip A1:1 C420jpeg\n"
+#define Y4M_FRAME_SIZE (FRAME_SIZE * 3 / 2)
+
+// creates an empty temporary file, the name of which is put in the given buffer
+#define TMP_FILE(name) \
+    char name[] = "/tmp/unit-test-framesink-XXXXXX"; \
+    do { \
+        const int fd_ = mkstemp(name); \
+        ck_assert_int_ne(fd_, -1); \
+        close(fd_); \
+    } while (0)
+
+// frame n: the color of pixel i is (i + n) % 4
+static void make_frame(uint8_t* pixels, size_t n)
+{
+    for (size_t i = 0; i < FRAME_SIZE; ++i) {
+        pixels[i] = (uint8_t) ((i + n) % 4);
+    }
+}
+
+// reads a pipe slowly, up to its end: a chunk every millisecond, returning the number of bytes read
+static void* slow_reader(void* arg)
+{
+    const int fd = *(const int*) arg;
+    static const struct timespec delay = { 0, 1000000 };
+    uint8_t chunk[4096];
+    size_t total = 0;
+    ssize_t n = 0;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        total += (size_t) n;
+        nanosleep(&delay, NULL);
+    }
+    return (void*) total;
+}
+
+// pushes frames to a sink writing to a pipe read slowly, returning the number of bytes read
+static size_t push_slowly(framesink_t* sink, int lossless, size_t nb_frames)
+{
+    int fds[2];
+    ck_assert_int_eq(pipe(fds), 0);
+    pthread_t reader;
+    ck_assert_int_eq(pthread_create(&reader, NULL, slow_reader, &fds[0]), 0);
+
+    char name[32];
+    snprintf(name, sizeof(name), "/dev/fd/%d", fds[1]);
+    ck_assert_err_none(framesink_open(sink, name, FRAMESINK_PPM, 1, lossless));
+    close(fds[1]); // the sink has its own
+
+    uint8_t pixels[FRAME_SIZE];
+    for (size_t n = 0; n < nb_frames; ++n) {
+        make_frame(pixels, n);
+        ck_assert_err_none(framesink_push(sink, pixels));
+    }
+    ck_assert_err_none(framesink_close(sink));
+
+    void* total = NULL;
+    pthread_join(reader, &total);
+    close(fds[0]);
+    return (size_t) total;
+}
+
+// reads a whole file, to be freed by the caller
+static uint8_t* read_file(const char* name, size_t* size)
+{
+    FILE* f = fopen(name, "rb");
+    ck_assert_ptr_nonnull(f);
+    fseek(f, 0, SEEK_END);
+    *size = (size_t) ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* content = malloc(*size + 1);
+    ck_assert_ptr_nonnull(content);
+    ck_assert_int_eq(fread(content, 1, *size, f), *size);
+    fclose(f);
+    return content;
+}
+
+START_TEST(framesink_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    framesink_t sink;
+    uint8_t pixels[FRAME_SIZE];
+    zero_init_var(sink);
+
+    ck_assert_bad_param(framesink_open(NULL, "-", FRAMESINK_PPM, 1, 1));
+    ck_assert_bad_param(framesink_open(&sink, NULL, FRAMESINK_PPM, 1, 1));
+    ck_assert_bad_param(framesink_open(&sink, "-", FRAMESINK_PPM, 0, 1));
+    ck_assert_bad_param(framesink_open(&sink, "-", (framesink_format_t) 7, 1, 1));
+    ck_assert_int_eq(framesink_open(&sink, "/nonexistent/dir/frames.ppm", FRAMESINK_PPM, 1, 1), ERR_IO);
+    ck_assert_bad_param(framesink_push(NULL, pixels));
+    ck_assert_bad_param(framesink_push(&sink, pixels)); // not open
+    ck_assert_bad_param(framesink_close(NULL));
+    ck_assert_bad_param(framesink_close(&sink));
+    ck_assert_bad_param(framesink_print_stats(NULL, stderr));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(framesink_ppm_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    static const uint8_t GREY[4] = { 255, 170, 85, 0 };
+    TMP_FILE(name);
+    framesink_t sink;
+    uint8_t pixels[FRAME_SIZE];
+
+    // one frame out of 3: frames 0, 3, 6 and 9
+    ck_assert_err_none(framesink_open(&sink, name, FRAMESINK_PPM, 3, 1));
+    for (size_t n = 0; n < 10; ++n) {
+        make_frame(pixels, n);
+        ck_assert_err_none(framesink_push(&sink, pixels));
+    }
+    ck_assert_err_none(framesink_close(&sink));
+    ck_assert_int_eq(sink.nb_pushed, 10);
+    ck_assert_int_eq(sink.nb_written, 4);
+    ck_assert_int_eq(sink.nb_dropped, 0);
+
+    size_t size = 0;
+    uint8_t* content = read_file(name, &size);
+    const size_t frame_size = strlen(PPM_HEADER) + 3 * FRAME_SIZE;
+    ck_assert_int_eq(size, 4 * frame_size);
+    for (size_t f = 0; f < 4; ++f) {
+        const uint8_t* frame = content + f * frame_size;
+        ck_assert_int_eq(memcmp(frame, PPM_HEADER, strlen(PPM_HEADER)), 0);
+        frame += strlen(PPM_HEADER);
+        for (size_t i = 0; i < FRAME_SIZE; ++i) {
+            const uint8_t grey = GREY[(i + 3 * f) % 4];
+            ck_assert_int_eq(frame[3 * i], grey);
+            ck_assert_int_eq(frame[3 * i + 1], grey);
+            ck_assert_int_eq(frame[3 * i + 2], grey);
+        }
+    }
+
+    free(content);
+    unlink(name);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(framesink_y4m_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    static const uint8_t LUMA[4] = { 235, 162, 89, 16 };
+    TMP_FILE(name);
+    framesink_t sink;
+    uint8_t pixels[FRAME_SIZE];
+
+    ck_assert_err_none(framesink_open(&sink, name, FRAMESINK_Y4M, 1, 1));
+    for (size_t n = 0; n < 5; ++n) {
+        make_frame(pixels, n);
+        ck_assert_err_none(framesink_push(&sink, pixels));
+    }
+    ck_assert_err_none(framesink_close(&sink));
+    ck_assert_int_eq(sink.nb_written, 5);
+
+    size_t size = 0;
+    uint8_t* content = read_file(name, &size);
+    ck_assert_int_eq(size, strlen(Y4M_HEADER) + 5 * (strlen("FRAME\n") + Y4M_FRAME_SIZE));
+    ck_assert_int_eq(memcmp(content, Y4M_HEADER, strlen(Y4M_HEADER)), 0);
+    const uint8_t* frame = content + strlen(Y4M_HEADER);
+    for (size_t f = 0; f < 5; ++f) {
+        ck_assert_int_eq(memcmp(frame, "FRAME\n", strlen("FRAME\n")), 0);
+        frame += strlen("FRAME\n");
+        for (size_t i = 0; i < FRAME_SIZE; ++i) {
+            ck_assert_int_eq(frame[i], LUMA[(i + f) % 4]);
+        }
+        for (size_t i = FRAME_SIZE; i < Y4M_FRAME_SIZE; ++i) {
+            ck_assert_int_eq(frame[i], 128);
+        }
+        frame += Y4M_FRAME_SIZE;
+    }
+
+    free(content);
+    unlink(name);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(framesink_drop_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    TMP_FILE(name);
+    framesink_t sink;
+    uint8_t pixels[FRAME_SIZE];
+
+    // pushed faster than written: whatever the timing, every frame is either written or dropped
+    ck_assert_err_none(framesink_open(&sink, name, FRAMESINK_PPM, 1, 1));
+    for (size_t n = 0; n < 1000; ++n) {
+        make_frame(pixels, n);
+        ck_assert_err_none(framesink_push(&sink, pixels));
+    }
+    ck_assert_err_none(framesink_close(&sink));
+    ck_assert_int_eq(sink.nb_written + sink.nb_dropped, 1000);
+    ck_assert(sink.nb_written >= FRAMESINK_RING_SIZE);
+#ifdef WITH_PRINT
+    framesink_print_stats(&sink, stdout);
+#endif
+
+    size_t size = 0;
+    uint8_t* content = read_file(name, &size);
+    const size_t frame_size = strlen(PPM_HEADER) + 3 * FRAME_SIZE;
+    ck_assert_int_eq(size, sink.nb_written * frame_size);
+    free(content);
+    unlink(name);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+START_TEST(framesink_slow_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    const size_t frame_size = strlen(PPM_HEADER) + 3 * FRAME_SIZE;
+    framesink_t sink;
+
+    // lossless: the pushes wait for the writer, every frame is written
+    size_t size = push_slowly(&sink, 1, 3 * FRAMESINK_RING_SIZE);
+    ck_assert_int_eq(sink.nb_written, 3 * FRAMESINK_RING_SIZE);
+    ck_assert_int_eq(sink.nb_dropped, 0);
+    ck_assert_int_eq(size, 3 * FRAMESINK_RING_SIZE * frame_size);
+
+    // otherwise, the ring fills up at once (each frame takes some 17 ms to be read)
+    size = push_slowly(&sink, 0, 3 * FRAMESINK_RING_SIZE);
+    ck_assert_int_eq(sink.nb_written + sink.nb_dropped, 3 * FRAMESINK_RING_SIZE);
+    ck_assert_int_ne(sink.nb_dropped, 0);
+    ck_assert_int_eq(size, sink.nb_written * frame_size);
+#ifdef WITH_PRINT
+    framesink_print_stats(&sink, stdout);
+#endif
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+// ======================================================================
+Suite* framesink_test_suite()
+{
+    Suite* s = suite_create("framesink.c Tests");
+
+    Add_Case(s, tc1, "Frame Sink Tests");
+    tcase_add_test(tc1, framesink_err);
+    tcase_add_test(tc1, framesink_ppm_exec);
+    tcase_add_test(tc1, framesink_y4m_exec);
+    tcase_add_test(tc1, framesink_drop_exec);
+    tcase_add_test(tc1, framesink_slow_exec);
+
+    return s;
+}
+
+TEST_SUITE(framesink_test_suite)
@@ -0,0 +1,666 @@
+/**
+ * @file unit-test-lcdc.c
+ * @brief Unit test code for the LCD controller
+ *
+ * @author E. Wengle, E. Garandel, EPFL
+ * @date 2020
+ */
+
+#include <stdlib.h>
+#include <string.h> // memcpy, memcmp
+#include <check.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "tests.h"
+#include "lcdc.h"
+#include "gameboy.h"
+
+#define BLACK 3
+#define WHITE 0
+#define IDENTITY_PALETTE 0xE4 // color i is i
+
+// gameboy_t is too big for the stack: the bus is backed by a plain 64k memory
+#define INIT \
+    gameboy_t* gb = calloc(1, sizeof(gameboy_t)); \
+    data_t* mem = calloc(1, 0x10000); \
+    ck_assert_ptr_nonnull(gb); \
+    ck_assert_ptr_nonnull(mem); \
+    for (size_t a = 0; a < 0x10000; ++a) { \
+        gb->bus[a] = &mem[a]; \
+    } \
+    gb->cpu.bus = &(gb->bus); \
+    lcdc_t* lcd = &(gb->screen)
+
+#define FREE \
+    lcdc_free(lcd); \
+    free(mem); \
+    free(gb)
+
+// runs the LCDC, switched on at cycle 0, up to the given cycle (excluded)
+#define RUN_UNTIL(cycle) \
+    ck_assert_err_none(lcdc_catch_up(lcd, cycle))
+
+// counting allocator: unit-test-lcdc is linked with --wrap for malloc, calloc and realloc
+static size_t nb_allocations = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    ++nb_allocations;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+    ++nb_allocations;
+    return __real_calloc(nmemb, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    ++nb_allocations;
+    return __real_realloc(ptr, size);
+}
+
+static uint8_t pixel(const lcdc_t* lcd, size_t x, size_t y)
+{
+    return lcdc_framebuffer(lcd)[y * LCD_WIDTH + x];
+}
+
+START_TEST(lcdc_init_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    ck_assert_bad_param(lcdc_init(NULL));
+    ck_assert_bad_param(lcdc_cycle(NULL, 0));
+    ck_assert_bad_param(lcdc_bus_listener(NULL, REG_LCDC));
+    ck_assert_int_eq(lcdc_next_event(NULL), UINT64_MAX);
+    ck_assert_ptr_null(lcdc_framebuffer(NULL));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lcdc_modes_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    ck_assert_err_none(lcdc_init(gb));
+    ck_assert_int_eq(lcdc_next_event(lcd), UINT64_MAX);
+
+    mem[REG_LCDC] = LCDC_REG_LCD_STATUS_MASK;
+    mem[REG_STAT] = 0x20 | 0x08; // LCD_STAT on mode 2 and mode 0
+    ck_assert_err_none(lcdc_bus_listener(lcd, REG_LCDC));
+
+    RUN_UNTIL(1);
+    ck_assert_int_eq(mem[REG_STAT] & STAT_REG_MODE_MASK, 2);
+    ck_assert_int_eq(mem[REG_LY], 0);
+    ck_assert(bit_get(gb->cpu.IF, LCD_STAT));
+    ck_assert_int_eq(lcdc_next_event(lcd), LINE_MODE_3_START_CYCLE);
+    gb->cpu.IF = 0;
+
+    RUN_UNTIL(LINE_MODE_3_START_CYCLE + 1);
+    ck_assert_int_eq(mem[REG_STAT] & STAT_REG_MODE_MASK, 3);
+    ck_assert_int_eq(gb->cpu.IF, 0);
+
+    RUN_UNTIL(LINE_MODE_0_START_CYCLE + 1);
+    ck_assert_int_eq(mem[REG_STAT] & STAT_REG_MODE_MASK, 0);
+    ck_assert(bit_get(gb->cpu.IF, LCD_STAT));
+
+    RUN_UNTIL(LINE_TOTAL_CYCLES + 1);
+    ck_assert_int_eq(mem[REG_LY], 1);
+    ck_assert_int_eq(mem[REG_STAT] & STAT_REG_MODE_MASK, 2);
+
+    RUN_UNTIL(LCD_HEIGHT * LINE_TOTAL_CYCLES + 1);
+    ck_assert_int_eq(mem[REG_LY], LCD_HEIGHT);
+    ck_assert_int_eq(mem[REG_STAT] & STAT_REG_MODE_MASK, 1);
+    ck_assert(bit_get(gb->cpu.IF, VBLANK));
+    ck_assert_int_eq(lcdc_next_vblank(lcd, lcd->cycles), LCD_HEIGHT * LINE_TOTAL_CYCLES + FRAME_TOTAL_CYCLES);
+
+    RUN_UNTIL(FRAME_TOTAL_CYCLES + 1);
+    ck_assert_int_eq(mem[REG_LY], 0);
+    ck_assert_int_eq(mem[REG_STAT] & STAT_REG_MODE_MASK, 2);
+
+    // switching off goes back to line 0 and stops all events
+    mem[REG_LCDC] = 0;
+    ck_assert_err_none(lcdc_bus_listener(lcd, REG_LCDC));
+    ck_assert_int_eq(mem[REG_STAT] & STAT_REG_MODE_MASK, 0);
+    ck_assert_int_eq(lcdc_next_event(lcd), UINT64_MAX);
+
+    FREE;
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lcdc_lyc_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    ck_assert_err_none(lcdc_init(gb));
+    mem[REG_LCDC] = LCDC_REG_LCD_STATUS_MASK;
+    mem[REG_LYC] = 3;
+    bit_set(&mem[REG_STAT], STAT_REG_INT_LYC_BIT);
+
+    RUN_UNTIL(3 * LINE_TOTAL_CYCLES);
+    ck_assert(!bit_get(mem[REG_STAT], STAT_REG_LYC_EQ_LY_BIT));
+    ck_assert_int_eq(gb->cpu.IF, 0);
+
+    RUN_UNTIL(3 * LINE_TOTAL_CYCLES + 1);
+    ck_assert(bit_get(mem[REG_STAT], STAT_REG_LYC_EQ_LY_BIT));
+    ck_assert(bit_get(gb->cpu.IF, LCD_STAT));
+
+    gb->cpu.IF = 0;
+    mem[REG_LYC] = 4;
+    ck_assert_err_none(lcdc_bus_listener(lcd, REG_LYC));
+    ck_assert(!bit_get(mem[REG_STAT], STAT_REG_LYC_EQ_LY_BIT));
+    ck_assert_int_eq(gb->cpu.IF, 0);
+
+    FREE;
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lcdc_render_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    ck_assert_err_none(lcdc_init(gb));
+
+    // tile 1: leftmost pixel column black; tile 2: fully black
+    for (size_t row = 0; row < 8; ++row) {
+        mem[TILE_SRC_ADDR_LOW + TILE_SIZE + 2 * row] = 0x80;
+        mem[TILE_SRC_ADDR_LOW + TILE_SIZE + 2 * row + 1] = 0x80;
+        mem[TILE_SRC_ADDR_LOW + 2 * TILE_SIZE + 2 * row] = 0xFF;
+        mem[TILE_SRC_ADDR_LOW + 2 * TILE_SIZE + 2 * row + 1] = 0xFF;
+    }
+    mem[TILE_ADDR_BASE_LOW + 1] = 1; // second tile of the first line
+    mem[REG_BGP] = IDENTITY_PALETTE;
+    mem[REG_OBP0] = IDENTITY_PALETTE;
+    mem[REG_SCX] = 4;
+
+    // sprite 0 (tile 2) at (20, 10), x-flipped tile 1 at (40, 10) behind the background
+    mem[GRAPH_RAM_START + 0] = 10 + 16;
+    mem[GRAPH_RAM_START + 1] = 20 + 8;
+    mem[GRAPH_RAM_START + 2] = 2;
+    mem[GRAPH_RAM_START + 4] = 10 + 16;
+    mem[GRAPH_RAM_START + 5] = 40 + 8;
+    mem[GRAPH_RAM_START + 6] = 1;
+    mem[GRAPH_RAM_START + 7] = 0x80 | 0x20;
+
+    mem[REG_LCDC] = LCDC_REG_LCD_STATUS_MASK | LCDC_REG_BG_MASK | LCDC_REG_OBJ_MASK | LCDC_REG_TILE_SOURCE_MASK;
+    RUN_UNTIL(FRAME_TOTAL_CYCLES);
+
+    ck_assert_int_eq(pixel(lcd, 3, 0), WHITE);
+    ck_assert_int_eq(pixel(lcd, 4, 0), BLACK);  // SCX = 4
+    ck_assert_int_eq(pixel(lcd, 5, 0), WHITE);
+    ck_assert_int_eq(pixel(lcd, 4, 8), WHITE);  // second tile line
+    ck_assert_int_eq(pixel(lcd, 19, 10), WHITE);
+    ck_assert_int_eq(pixel(lcd, 20, 10), BLACK);
+    ck_assert_int_eq(pixel(lcd, 27, 10), BLACK);
+    ck_assert_int_eq(pixel(lcd, 28, 10), WHITE);
+    ck_assert_int_eq(pixel(lcd, 40, 10), WHITE);
+    ck_assert_int_eq(pixel(lcd, 47, 10), BLACK); // flipped
+    ck_assert_int_eq(pixel(lcd, 20, 18), WHITE);
+
+    image_t image;
+    ck_assert_err_none(lcdc_to_image(lcd, &image));
+
+    // a frame is a single block: one allocation to create it, none to copy it
+    image_t copy;
+    nb_allocations = 0;
+    ck_assert_err_none(image_create(&copy, LCD_WIDTH, LCD_HEIGHT));
+    ck_assert_err_none(image_copy(&copy, &image));
+    ck_assert_int_eq(nb_allocations, 1);
+    image_free(&image);
+
+    for (size_t y = 0; y < LCD_HEIGHT; ++y) {
+        for (size_t x = 0; x < LCD_WIDTH; ++x) {
+            uint8_t p = 0;
+            ck_assert_err_none(image_get_pixel(&p, &copy, x, y));
+            ck_assert_int_eq(p, pixel(lcd, x, y));
+        }
+    }
+    image_free(&copy);
+
+    FREE;
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lcdc_render_no_alloc)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    ck_assert_err_none(lcdc_init(gb));
+
+    // random tiles and sprites, background, window and sprites all enabled
+    for (size_t a = TILE_SRC_ADDR_LOW; a < TILE_ADDR_BASE_HIGH + 0x400; ++a) {
+        mem[a] = (data_t) rand();
+    }
+    for (size_t a = GRAPH_RAM_START; a <= GRAPH_RAM_END; ++a) {
+        mem[a] = (data_t) rand();
+    }
+    mem[REG_BGP] = mem[REG_OBP0] = IDENTITY_PALETTE;
+    mem[REG_OBP1] = 0x1B;
+    mem[REG_WX] = 50;
+    mem[REG_WY] = 20;
+    mem[REG_LCDC] = 0xFF;
+
+    nb_allocations = 0;
+    RUN_UNTIL(2 * FRAME_TOTAL_CYCLES);
+    ck_assert_int_eq(nb_allocations, 0);
+
+    FREE;
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+START_TEST(lcdc_palette_map_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    const size_t size = 45; // partial last word
+    image_line_t line, out;
+    ck_assert_err_none(image_line_create(&line, size));
+    ck_assert_err_none(image_line_create(&out, size));
+    for (size_t w = 0; w < line.msb->nb_fields; ++w) {
+        ck_assert_err_none(image_line_set_word(&line, w, (uint32_t) rand(), (uint32_t) rand()));
+    }
+
+    for (unsigned map = 0; map <= 0xFF; ++map) {
+        ck_assert_err_none(image_line_map_colors_into(&out, line, (palette_t) map));
+        for (size_t x = 0; x < 64; ++x) {
+            const unsigned color = (unsigned) (bit_vector_get(line.msb, x) << 1 | bit_vector_get(line.lsb, x));
+            const unsigned expected = x < size ? (map >> (2 * color)) & 3 : 0;
+            ck_assert_uint_eq((unsigned) (bit_vector_get(out.msb, x) << 1 | bit_vector_get(out.lsb, x)), expected);
+            ck_assert_int_eq(bit_vector_get(out.opacity, x), bit_vector_get(line.opacity, x));
+        }
+    }
+    ck_assert_uint_eq(out.msb->content[1] >> (size - 32), 0);
+
+    // mapping the identity in place leaves the line as it is
+    const uint32_t msb0 = line.msb->content[0], lsb0 = line.lsb->content[0];
+    ck_assert_err_none(image_line_map_colors_into(&line, line, IDENTITY_PALETTE));
+    ck_assert_uint_eq(line.msb->content[0], msb0);
+    ck_assert_uint_eq(line.lsb->content[0], lsb0);
+
+    image_line_free(&line);
+    image_line_free(&out);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+START_TEST(lcdc_tile_cache_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    ck_assert_err_none(lcdc_init(gb));
+
+    // tile 0x110 (signed index 0x10, from TILE_SRC_ADDR_HIGH) fully black, everywhere on the map
+    for (size_t a = 0; a < TILE_SIZE; ++a) {
+        mem[TILE_SRC_ADDR_LOW + 0x110 * TILE_SIZE + a] = 0xFF;
+    }
+    for (size_t a = TILE_ADDR_BASE_LOW; a < TILE_ADDR_BASE_HIGH; ++a) {
+        mem[a] = 0x10;
+    }
+    mem[REG_BGP] = IDENTITY_PALETTE;
+    mem[REG_LCDC] = LCDC_REG_LCD_STATUS_MASK | LCDC_REG_BG_MASK;
+    RUN_UNTIL(FRAME_TOTAL_CYCLES);
+    ck_assert_int_eq(pixel(lcd, 0, 0), BLACK);
+    ck_assert_int_eq(pixel(lcd, 159, 143), BLACK);
+
+    // a 16-bit write ending on the first byte of the tile is reported at the end of the previous one
+    const addr_t row = (addr_t) (TILE_SRC_ADDR_LOW + 0x110 * TILE_SIZE);
+    mem[row - 1] = 0x00;
+    mem[row] = 0x7F;
+    ck_assert_err_none(lcdc_bus_listener(lcd, (addr_t) (row - 1)));
+    RUN_UNTIL(2 * FRAME_TOTAL_CYCLES);
+    ck_assert_int_eq(pixel(lcd, 0, 0), 2);
+    ck_assert_int_eq(pixel(lcd, 1, 0), BLACK);
+    ck_assert_int_eq(pixel(lcd, 8, 0), 2);
+    ck_assert_int_eq(pixel(lcd, 0, 1), BLACK);
+
+    FREE;
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+START_TEST(lcdc_sprite_cache_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    INIT;
+    ck_assert_err_none(lcdc_init(gb));
+
+    // tile 2 fully black, tile 3 white: sprite 0 at (0, 0)
+    for (size_t a = 0; a < TILE_SIZE; ++a) {
+        mem[TILE_SRC_ADDR_LOW + 2 * TILE_SIZE + a] = 0xFF;
+    }
+    mem[REG_OBP0] = IDENTITY_PALETTE;
+    mem[GRAPH_RAM_START + 0] = 16;
+    mem[GRAPH_RAM_START + 1] = 8;
+    mem[GRAPH_RAM_START + 2] = 2;
+    mem[REG_LCDC] = LCDC_REG_LCD_STATUS_MASK | LCDC_REG_OBJ_MASK;
+    RUN_UNTIL(FRAME_TOTAL_CYCLES);
+    ck_assert_int_eq(pixel(lcd, 0, 0), BLACK);
+    ck_assert_int_eq(pixel(lcd, 0, 8), WHITE);
+
+    // 8x16 sprites: the lists are rebuilt for the new size (tile 3 below tile 2)
+    mem[REG_LCDC] |= LCDC_REG_OBJ_SIZE_MASK;
+    RUN_UNTIL(2 * FRAME_TOTAL_CYCLES);
+    ck_assert_int_eq(pixel(lcd, 0, 7), BLACK);
+    ck_assert_int_eq(pixel(lcd, 0, 8), WHITE);
+    ck_assert_int_eq(pixel(lcd, 0, 16), WHITE);
+
+    // moving the sprite down in OAM, and tile 3 becoming black
+    mem[GRAPH_RAM_START + 0] = 16 + 100;
+    ck_assert_err_none(lcdc_bus_listener(lcd, GRAPH_RAM_START));
+    for (size_t a = 0; a < TILE_SIZE; ++a) {
+        mem[TILE_SRC_ADDR_LOW + 3 * TILE_SIZE + a] = 0xFF;
+        ck_assert_err_none(lcdc_bus_listener(lcd, (addr_t) (TILE_SRC_ADDR_LOW + 3 * TILE_SIZE + a)));
+    }
+    RUN_UNTIL(3 * FRAME_TOTAL_CYCLES);
+    ck_assert_int_eq(pixel(lcd, 0, 0), WHITE);
+    ck_assert_int_eq(pixel(lcd, 0, 100), BLACK);
+    ck_assert_int_eq(pixel(lcd, 0, 115), BLACK);
+    ck_assert_int_eq(pixel(lcd, 0, 116), WHITE);
+
+    // at most 10 sprites per line, the first ones in OAM order, drawn by increasing x
+    for (size_t i = 0; i < 12; ++i) {
+        mem[GRAPH_RAM_START + 4 * i + 0] = 16 + 50;
+        mem[GRAPH_RAM_START + 4 * i + 1] = (data_t) (8 + 8 * (11 - i));
+        mem[GRAPH_RAM_START + 4 * i + 2] = 2;
+        ck_assert_err_none(lcdc_bus_listener(lcd, (addr_t) (GRAPH_RAM_START + 4 * i)));
+    }
+    RUN_UNTIL(4 * FRAME_TOTAL_CYCLES);
+    ck_assert_int_eq(pixel(lcd, 0, 50), WHITE);  // sprite 11
+    ck_assert_int_eq(pixel(lcd, 8, 50), WHITE);  // sprite 10
+    ck_assert_int_eq(pixel(lcd, 16, 50), BLACK); // sprite 9
+    ck_assert_int_eq(pixel(lcd, 95, 50), BLACK); // sprite 0
+
+    FREE;
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+#define PARALLEL_FRAMES 4
+
+/**
+ * @brief Renders random frames, with registers, VRAM and OAM changing in the middle of them
+ * @param nb_threads number of rendering threads
+ * @param pipeline whether to render with the pipeline (taking the frames from its queue)
+ * @param frames (modified) PARALLEL_FRAMES framebuffers
+ */
+static void render_random_frames(size_t nb_threads, bit_t pipeline, uint8_t* frames)
+{
+    INIT;
+    ck_assert_err_none(lcdc_init(gb));
+    ck_assert_err_none(lcdc_set_render_threads(lcd, nb_threads));
+
+    srand(42);
+    for (size_t a = TILE_SRC_ADDR_LOW; a < TILE_ADDR_BASE_HIGH + 0x400; ++a) {
+        mem[a] = (data_t) rand();
+    }
+    for (size_t a = GRAPH_RAM_START; a <= GRAPH_RAM_END; ++a) {
+        mem[a] = (data_t) rand();
+    }
+    ck_assert_err_none(lcdc_set_render_threads(lcd, nb_threads)); // VRAM and OAM written behind its back
+    ck_assert_err_none(lcdc_set_pipeline(lcd, pipeline));
+    mem[REG_LCDC] = 0xFF;
+
+    static const addr_t regs[] = { REG_SCY, REG_SCX, REG_BGP, REG_OBP0, REG_OBP1, REG_WX, REG_WY, REG_LCDC };
+    uint64_t cycle = 0;
+    for (size_t f = 0; f < PARALLEL_FRAMES; ++f) {
+        const uint64_t end = (f + 1) * FRAME_TOTAL_CYCLES;
+        while (cycle < end) {
+            cycle += 1 + (uint64_t) rand() % (3 * LINE_TOTAL_CYCLES);
+            if (cycle > end) cycle = end;
+            RUN_UNTIL(cycle);
+
+            const addr_t reg = regs[(size_t) rand() % (sizeof(regs) / sizeof(regs[0]))];
+            mem[reg] = (data_t) (reg == REG_LCDC ? rand() | LCDC_REG_LCD_STATUS_MASK : rand());
+
+            const addr_t a = (addr_t) (rand() % 2 ? TILE_SRC_ADDR_LOW + rand() % 0x2000
+                                                  : GRAPH_RAM_START + rand() % (GRAPH_RAM_END - GRAPH_RAM_START + 1));
+            mem[a] = (data_t) rand();
+            ck_assert_err_none(lcdc_bus_listener(lcd, a));
+        }
+        if (pipeline) {
+            lcdc_framebuffer_t* const frame = (lcdc_framebuffer_t*) (frames + f * LCD_WIDTH * LCD_HEIGHT);
+            ck_assert_err_none(lcdc_flush(lcd));
+            ck_assert(lcdc_pop_frame(lcd, frame, NULL));
+            ck_assert(!lcdc_pop_frame(lcd, frame + 1, NULL));
+            ck_assert_int_eq(memcmp(frame, lcdc_framebuffer(lcd), LCD_WIDTH * LCD_HEIGHT), 0);
+        } else {
+            memcpy(frames + f * LCD_WIDTH * LCD_HEIGHT, lcdc_framebuffer(lcd), LCD_WIDTH * LCD_HEIGHT);
+        }
+    }
+
+    FREE;
+}
+
+START_TEST(lcdc_parallel_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    ck_assert_bad_param(lcdc_set_render_threads(NULL, 2));
+    {
+        INIT;
+        ck_assert_err_none(lcdc_init(gb));
+        ck_assert_bad_param(lcdc_set_render_threads(lcd, 0));
+        ck_assert_bad_param(lcdc_set_render_threads(lcd, LCD_HEIGHT + 1));
+        FREE;
+    }
+
+    static uint8_t sequential[PARALLEL_FRAMES * LCD_WIDTH * LCD_HEIGHT];
+    static uint8_t parallel[PARALLEL_FRAMES * LCD_WIDTH * LCD_HEIGHT];
+    render_random_frames(1, 0, sequential);
+    for (size_t n = 2; n <= 4; ++n) {
+        memset(parallel, 0, sizeof(parallel));
+        render_random_frames(n, 0, parallel);
+        ck_assert_int_eq(memcmp(sequential, parallel, sizeof(parallel)), 0);
+    }
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(lcdc_pipeline_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    lcdc_framebuffer_t frame;
+    ck_assert_bad_param(lcdc_set_pipeline(NULL, 1));
+    ck_assert(!lcdc_pop_frame(NULL, &frame, NULL));
+    {
+        INIT;
+        ck_assert_err_none(lcdc_init(gb));
+        ck_assert(!lcdc_pop_frame(lcd, &frame, NULL));
+        ck_assert_err_none(lcdc_set_render_threads(lcd, 2));
+        ck_assert_bad_param(lcdc_set_pipeline(lcd, 1));
+        ck_assert_err_none(lcdc_set_render_threads(lcd, 1));
+        ck_assert_err_none(lcdc_set_pipeline(lcd, 1));
+        ck_assert_bad_param(lcdc_set_render_threads(lcd, 2));
+
+        // frames not taken are dropped once the queue is full
+        mem[REG_LCDC] = 0xFF;
+        RUN_UNTIL((LCDC_FRAME_QUEUE_SIZE + 2) * FRAME_TOTAL_CYCLES);
+        ck_assert_err_none(lcdc_flush(lcd));
+        for (size_t f = 0; f < LCDC_FRAME_QUEUE_SIZE; ++f) {
+            ck_assert(lcdc_pop_frame(lcd, &frame, NULL));
+        }
+        ck_assert(!lcdc_pop_frame(lcd, &frame, NULL));
+        FREE; // with the pipeline still on
+    }
+
+    static uint8_t sequential[PARALLEL_FRAMES * LCD_WIDTH * LCD_HEIGHT];
+    static uint8_t pipelined[PARALLEL_FRAMES * LCD_WIDTH * LCD_HEIGHT];
+    render_random_frames(1, 0, sequential);
+    render_random_frames(1, 1, pipelined);
+    ck_assert_int_eq(memcmp(sequential, pipelined, sizeof(pipelined)), 0);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+// checks that exactly the lines first to end (excluded) are dirty, and clears them
+static void check_dirty(bit_t* dirty, size_t first, size_t end)
+{
+    for (size_t y = 0; y < LCD_HEIGHT; ++y) {
+        ck_assert_int_eq(dirty[y], y >= first && y < end);
+    }
+    memset(dirty, 0, LCD_HEIGHT * sizeof(bit_t));
+}
+
+START_TEST(lcdc_dirty_lines_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    bit_t dirty[LCD_HEIGHT] = { 0 };
+    ck_assert(!lcdc_take_dirty_lines(NULL, dirty));
+
+    INIT;
+    ck_assert_err_none(lcdc_init(gb));
+    ck_assert(lcdc_take_dirty_lines(lcd, dirty));
+    check_dirty(dirty, 0, LCD_HEIGHT);
+
+    // white tile 0 everywhere, as the initial display: nothing changes
+    for (size_t a = 0; a < TILE_SIZE; ++a) {
+        mem[TILE_SRC_ADDR_LOW + TILE_SIZE + a] = 0xFF;
+    }
+    mem[REG_BGP] = IDENTITY_PALETTE;
+    mem[REG_LCDC] = LCDC_REG_LCD_STATUS_MASK | LCDC_REG_BG_MASK | LCDC_REG_TILE_SOURCE_MASK;
+    RUN_UNTIL(FRAME_TOTAL_CYCLES);
+    ck_assert(!lcdc_take_dirty_lines(lcd, dirty));
+    check_dirty(dirty, 0, 0);
+
+    // black tile 1 on the third row of tiles: its lines only
+    const addr_t tile = TILE_ADDR_BASE_LOW + 2 * TILE_LINE_SIZE;
+    mem[tile] = 1;
+    ck_assert_err_none(lcdc_bus_listener(lcd, tile));
+    RUN_UNTIL(2 * FRAME_TOTAL_CYCLES);
+    ck_assert(lcdc_take_dirty_lines(lcd, dirty));
+    check_dirty(dirty, 2 * TILE_HEIGHT, 3 * TILE_HEIGHT);
+
+    RUN_UNTIL(3 * FRAME_TOTAL_CYCLES);
+    ck_assert(!lcdc_take_dirty_lines(lcd, dirty));
+
+    // with the pipeline, the lines changed come with the frames, those of dropped frames included
+    lcdc_framebuffer_t frame;
+    ck_assert_err_none(lcdc_set_pipeline(lcd, 1));
+    RUN_UNTIL(4 * FRAME_TOTAL_CYCLES);
+    ck_assert_err_none(lcdc_flush(lcd));
+    ck_assert(lcdc_pop_frame(lcd, &frame, dirty));
+    check_dirty(dirty, 0, LCD_HEIGHT);
+
+    // the queue full, the frame where the tile goes away is dropped
+    RUN_UNTIL((4 + LCDC_FRAME_QUEUE_SIZE) * FRAME_TOTAL_CYCLES);
+    mem[tile] = 0;
+    ck_assert_err_none(lcdc_bus_listener(lcd, tile));
+    RUN_UNTIL((5 + LCDC_FRAME_QUEUE_SIZE) * FRAME_TOTAL_CYCLES);
+    ck_assert_err_none(lcdc_flush(lcd));
+    for (size_t f = 0; f < LCDC_FRAME_QUEUE_SIZE; ++f) {
+        ck_assert(lcdc_pop_frame(lcd, &frame, dirty));
+    }
+    ck_assert(!lcdc_pop_frame(lcd, &frame, dirty));
+    check_dirty(dirty, 0, 0);
+
+    RUN_UNTIL((6 + LCDC_FRAME_QUEUE_SIZE) * FRAME_TOTAL_CYCLES);
+    ck_assert_err_none(lcdc_flush(lcd));
+    ck_assert(lcdc_pop_frame(lcd, &frame, dirty));
+    check_dirty(dirty, 2 * TILE_HEIGHT, 3 * TILE_HEIGHT);
+    ck_assert_int_eq(frame[2 * TILE_HEIGHT][0], WHITE);
+
+    FREE;
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+// ======================================================================
+Suite* lcdc_test_suite()
+{
+    Suite* s = suite_create("lcdc.c Tests");
+
+    Add_Case(s, tc1, "LCDC Tests");
+    tcase_add_test(tc1, lcdc_init_err);
+    tcase_add_test(tc1, lcdc_modes_exec);
+    tcase_add_test(tc1, lcdc_lyc_exec);
+    tcase_add_test(tc1, lcdc_render_exec);
+    tcase_add_test(tc1, lcdc_render_no_alloc);
+    tcase_add_test(tc1, lcdc_palette_map_exec);
+    tcase_add_test(tc1, lcdc_tile_cache_exec);
+    tcase_add_test(tc1, lcdc_sprite_cache_exec);
+    tcase_add_test(tc1, lcdc_parallel_exec);
+    tcase_add_test(tc1, lcdc_pipeline_exec);
+    tcase_add_test(tc1, lcdc_dirty_lines_exec);
+
+    return s;
+}
+
+TEST_SUITE(lcdc_test_suite)
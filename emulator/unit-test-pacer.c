@@ -0,0 +1,176 @@
+/**
+ * @file unit-test-pacer.c
+ * @brief Unit test code for the real-time pacing of the emulation
+ *
+ * @author E. Wengle, E. Garandel, EPFL
+ * @date 2020
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <check.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "tests.h"
+#include "pacer.h"
+#include "gameboy.h" // GB_CYCLES_PER_S
+#include "lcdc.h"    // FRAME_TOTAL_CYCLES
+#include "error.h"
+
+#define NS_PER_S 1000000000ull
+
+// duration of a Game Boy frame, in ns (16.74 ms, 59.7275 Hz)
+#define FRAME_NS ((uint64_t) FRAME_TOTAL_CYCLES * NS_PER_S / GB_CYCLES_PER_S)
+
+// an origin of the schedule, far enough from 0
+#define ORIGIN (1000 * NS_PER_S)
+
+// restarts the schedule of a pacer from ORIGIN, without reading the clock
+static void pacer_set_origin(pacer_t* pacer)
+{
+    ck_assert_err_none(pacer_init(pacer));
+    pacer->origin = ORIGIN;
+    pacer->frames = 0;
+}
+
+// ticks a pacer on the refreshes of a display during 10 s, returning the number of frames emulated
+// (refresh being the interval told to the pacer, 0 if unknown)
+static uint64_t simulate_display(pacer_t* pacer, uint64_t interval, uint64_t refresh)
+{
+    pacer_set_origin(pacer);
+    uint64_t total = 0;
+    for (uint64_t now = ORIGIN + interval; now < ORIGIN + 10 * NS_PER_S; now += interval) {
+        uint64_t nb_frames = 0;
+        ck_assert_err_none(pacer_tick(pacer, now, refresh, 4, &nb_frames));
+        ck_assert(nb_frames <= 4);
+        total += nb_frames;
+    }
+    return total;
+}
+
+START_TEST(pacer_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    pacer_t pacer;
+    uint64_t nb_frames = 0;
+    zero_init_var(pacer);
+
+    ck_assert_bad_param(pacer_init(NULL));
+    ck_assert_bad_param(pacer_restart(NULL));
+    ck_assert_bad_param(pacer_wait(NULL, 1, &nb_frames));
+    ck_assert_bad_param(pacer_wait(&pacer, 1, NULL));
+    ck_assert_bad_param(pacer_wait(&pacer, 0, &nb_frames));
+    ck_assert_bad_param(pacer_tick(NULL, ORIGIN, 0, 1, &nb_frames));
+    ck_assert_bad_param(pacer_tick(&pacer, ORIGIN, 0, 1, NULL));
+    ck_assert_bad_param(pacer_tick(&pacer, ORIGIN, 0, 0, &nb_frames));
+    ck_assert_bad_param(pacer_print_stats(NULL, stderr));
+    ck_assert_bad_param(pacer_print_stats(&pacer, NULL));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(pacer_tick_rates_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    pacer_t pacer;
+
+    // same rate (within PACER_RATE_TOLERANCE): one frame per refresh, the display driving
+    ck_assert_int_eq(simulate_display(&pacer, NS_PER_S / 60, NS_PER_S / 60), 600);
+    ck_assert_int_eq(pacer.nb_ticks, 600);
+    ck_assert_int_eq(simulate_display(&pacer, NS_PER_S * 100 / 5973, NS_PER_S * 100 / 5973), 597);
+
+    // other rates: resampled, frames 0 to 597 being due by the last refresh, just before 10 s
+    // (597 frames of 16.74 ms being 9.995 s)
+    ck_assert_int_eq(simulate_display(&pacer, NS_PER_S / 120, NS_PER_S / 120), 598);
+    ck_assert_int_eq(simulate_display(&pacer, NS_PER_S / 30, NS_PER_S / 30), 598);
+    ck_assert_int_eq(simulate_display(&pacer, NS_PER_S / 75, NS_PER_S / 75), 598);
+    ck_assert_int_eq(pacer.nb_dropped, 0);
+
+    // refresh interval unknown: resampled as well, the last refresh being at 9.98 s
+    ck_assert_int_eq(simulate_display(&pacer, NS_PER_S / 50, 0), 597);
+#ifdef WITH_PRINT
+    pacer_print_stats(&pacer, stdout);
+#endif
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(pacer_catch_up_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    pacer_t pacer;
+    uint64_t nb_frames = 0;
+    pacer_set_origin(&pacer);
+
+    // frames 0 to 2 due: caught up at once
+    ck_assert_err_none(pacer_tick(&pacer, ORIGIN + 2 * FRAME_NS + FRAME_NS / 2, 0, 4, &nb_frames));
+    ck_assert_int_eq(nb_frames, 3);
+    ck_assert_int_eq(pacer.frames, 3);
+
+    // ...and not again
+    ck_assert_err_none(pacer_tick(&pacer, ORIGIN + 2 * FRAME_NS + FRAME_NS / 2, 0, 4, &nb_frames));
+    ck_assert_int_eq(nb_frames, 0);
+
+    // frames 3 to 12 due (a stall): 4 caught up, 6 dropped, and the schedule rebased on now
+    const uint64_t now = ORIGIN + 12 * FRAME_NS + FRAME_NS / 2;
+    ck_assert_err_none(pacer_tick(&pacer, now, 0, 4, &nb_frames));
+    ck_assert_int_eq(nb_frames, 4);
+    ck_assert_int_eq(pacer.nb_dropped, 6);
+    ck_assert_int_eq(pacer.origin, now);
+    ck_assert_int_eq(pacer.frames, 1);
+
+    // the next frame is due a frame after the stall
+    ck_assert_err_none(pacer_tick(&pacer, now + FRAME_NS / 2, 0, 4, &nb_frames));
+    ck_assert_int_eq(nb_frames, 0);
+    ck_assert_err_none(pacer_tick(&pacer, now + FRAME_NS + FRAME_NS / 2, 0, 4, &nb_frames));
+    ck_assert_int_eq(nb_frames, 1);
+    ck_assert_int_eq(pacer.nb_dropped, 6);
+    ck_assert_int_eq(pacer.nb_ticks, 3 + 4 + 1);
+
+    // waiting while (far) behind schedule: no sleep, at most max_frames, the others dropped
+    pacer_set_origin(&pacer);
+    pacer.origin = 0;
+    ck_assert_err_none(pacer_wait(&pacer, 2, &nb_frames));
+    ck_assert_int_eq(nb_frames, 2);
+    ck_assert_int_eq(pacer.nb_late, 2);
+    ck_assert_int_ne(pacer.nb_dropped, 0);
+    ck_assert_int_eq(pacer.frames, 1);
+    ck_assert_int_ne(pacer.origin, 0);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+// ======================================================================
+Suite* pacer_test_suite()
+{
+    Suite* s = suite_create("pacer.c Tests");
+
+    Add_Case(s, tc1, "Pacer Tests");
+    tcase_add_test(tc1, pacer_err);
+    tcase_add_test(tc1, pacer_tick_rates_exec);
+    tcase_add_test(tc1, pacer_catch_up_exec);
+
+    return s;
+}
+
+TEST_SUITE(pacer_test_suite)
@@ -0,0 +1,196 @@
+/**
+ * @file unit-test-shmexport.c
+ * @brief Unit test code for the export of the frames through shared memory
+ *
+ * @author E. Wengle, E. Garandel, EPFL
+ * @date 2020
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h> // getpid
+#include <check.h>
+#include <inttypes.h>
+
+#include "util.h"
+#include "tests.h"
+#include "shmexport.h"
+#include "lcdc.h"
+#include "joypad.h"
+#include "error.h"
+
+#define FRAME_SIZE (LCD_HEIGHT * LCD_WIDTH)
+
+// name of a segment of this process only
+#define SEGMENT_NAME(name) \
+    char name[64]; \
+    snprintf(name, sizeof(name), "/unit-test-shmexport-%d", (int) getpid())
+
+// frame n: the color of pixel i is (i + n) % 4
+static void make_frame(uint8_t* pixels, size_t n)
+{
+    for (size_t i = 0; i < FRAME_SIZE; ++i) {
+        pixels[i] = (uint8_t) ((i + n) % 4);
+    }
+}
+
+START_TEST(shmexport_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    shmexport_t exp;
+    joypad_t pad;
+    uint8_t pixels[FRAME_SIZE];
+    unsigned seq = 0;
+    zero_init_var(exp);
+    zero_init_var(pad);
+
+    ck_assert_bad_param(shmexport_open(NULL, "/gameboy"));
+    ck_assert_bad_param(shmexport_open(&exp, NULL));
+    ck_assert_bad_param(shmexport_map(NULL, "/gameboy"));
+    ck_assert_bad_param(shmexport_map(&exp, NULL));
+    ck_assert_bad_param(shmexport_publish(NULL, pixels, 0, &pad));
+    ck_assert_bad_param(shmexport_publish(&exp, pixels, 0, &pad)); // not open
+    ck_assert_bad_param(shmexport_close(NULL));
+    ck_assert_bad_param(shmexport_close(&exp));
+    ck_assert_ptr_null(shmexport_read_begin(NULL, &seq));
+    ck_assert_ptr_null(shmexport_read_begin(&exp, &seq));
+    ck_assert_int_eq(shmexport_read_valid(NULL, 0), 0);
+
+    // no such segment
+    SEGMENT_NAME(name);
+    ck_assert_int_eq(shmexport_map(&exp, name), ERR_IO);
+
+    // read-only
+    shmexport_t writer;
+    ck_assert_err_none(shmexport_open(&writer, name));
+    ck_assert_err_none(shmexport_map(&exp, name));
+    ck_assert_bad_param(shmexport_publish(&exp, pixels, 0, &pad));
+    ck_assert_err_none(shmexport_close(&exp));
+    ck_assert_err_none(shmexport_close(&writer));
+
+    // removed once closed by the emulator
+    ck_assert_int_eq(shmexport_map(&exp, name), ERR_IO);
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(shmexport_publish_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    SEGMENT_NAME(name);
+    shmexport_t writer, reader;
+    joypad_t pad;
+    uint8_t pixels[FRAME_SIZE];
+    unsigned seq = 0;
+    zero_init_var(pad);
+
+    ck_assert_err_none(shmexport_open(&writer, name));
+    ck_assert_err_none(shmexport_map(&reader, name));
+    ck_assert_int_eq(reader.segment->width, LCD_WIDTH);
+    ck_assert_int_eq(reader.segment->height, LCD_HEIGHT);
+    ck_assert_ptr_null(shmexport_read_begin(&reader, &seq)); // nothing published yet
+
+    // UP and A pressed (see joypad_key_pressed())
+    pad.keys_state[0] = 1 << UP_KEY;
+    pad.keys_state[1] = 1 << (A_KEY - NB_GB_KEY_COLS);
+    for (uint64_t n = 1; n <= 10; ++n) {
+        make_frame(pixels, n);
+        ck_assert_err_none(shmexport_publish(&writer, pixels, n, &pad));
+
+        const shmexport_buffer_t* b = shmexport_read_begin(&reader, &seq);
+        ck_assert_ptr_nonnull(b);
+        ck_assert_int_eq(seq % 2, 0);
+        ck_assert_int_eq(b->frame, n);
+        ck_assert_int_eq(b->keys, (1 << UP_KEY) | (1 << A_KEY));
+        ck_assert_int_eq(memcmp(b->pixels, pixels, FRAME_SIZE), 0);
+        ck_assert(shmexport_read_valid(b, seq));
+    }
+
+    ck_assert_err_none(shmexport_close(&reader));
+    ck_assert_err_none(shmexport_close(&writer));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+START_TEST(shmexport_overwritten_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    SEGMENT_NAME(name);
+    shmexport_t writer, reader;
+    joypad_t pad;
+    uint8_t pixels[FRAME_SIZE];
+    unsigned seq = 0;
+    zero_init_var(pad);
+    make_frame(pixels, 0);
+
+    ck_assert_err_none(shmexport_open(&writer, name));
+    ck_assert_err_none(shmexport_map(&reader, name));
+    ck_assert_err_none(shmexport_publish(&writer, pixels, 0, &pad));
+
+    // the frame read remains valid for two more frames, the third one being written over it
+    const shmexport_buffer_t* b = shmexport_read_begin(&reader, &seq);
+    ck_assert_ptr_nonnull(b);
+    for (uint64_t n = 1; n <= 2; ++n) {
+        ck_assert_err_none(shmexport_publish(&writer, pixels, n, &pad));
+        ck_assert(shmexport_read_valid(b, seq));
+        ck_assert_int_eq(b->frame, 0);
+    }
+    ck_assert_err_none(shmexport_publish(&writer, pixels, 3, &pad));
+    ck_assert(!shmexport_read_valid(b, seq));
+
+    // read again: the latest frame
+    b = shmexport_read_begin(&reader, &seq);
+    ck_assert_ptr_nonnull(b);
+    ck_assert_int_eq(b->frame, 3);
+    ck_assert(shmexport_read_valid(b, seq));
+
+    // emulator killed while publishing: the latest frame is being written for ever, which is given up on
+    shmexport_buffer_t* const latest = &(writer.segment->buffers[writer.segment->latest]);
+    atomic_fetch_add(&(latest->seq), 1);
+    ck_assert_ptr_null(shmexport_read_begin(&reader, &seq));
+    atomic_fetch_add(&(latest->seq), 1);
+    b = shmexport_read_begin(&reader, &seq);
+    ck_assert_ptr_nonnull(b);
+    ck_assert_int_eq(b->frame, 3);
+    ck_assert(shmexport_read_valid(b, seq));
+
+    ck_assert_err_none(shmexport_close(&reader));
+    ck_assert_err_none(shmexport_close(&writer));
+
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+}
+END_TEST
+
+
+// ======================================================================
+Suite* shmexport_test_suite()
+{
+    Suite* s = suite_create("shmexport.c Tests");
+
+    Add_Case(s, tc1, "Shared-Memory Export Tests");
+    tcase_add_test(tc1, shmexport_err);
+    tcase_add_test(tc1, shmexport_publish_exec);
+    tcase_add_test(tc1, shmexport_overwritten_exec);
+
+    return s;
+}
+
+TEST_SUITE(shmexport_test_suite)
@@ -134,6 +134,82 @@ START_TEST(timer_cycle_exec)
 }
 END_TEST
 
+START_TEST(timer_catch_up_err)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    ck_assert_bad_param(timer_catch_up(NULL, 0));
+    ck_assert_int_eq(timer_next_event(NULL), UINT64_MAX);
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
+#define CATCH_UP_TAC_COUNT 8
+#define CATCH_UP_STEP_COUNT 50
+#define CATCH_UP_STEP_MAX 0x1000
+
+START_TEST(timer_catch_up_exec)
+{
+// ------------------------------------------------------------
+#ifdef WITH_PRINT
+    printf("=== %s:\n", __func__);
+#endif
+    for (data_t tac = 0; tac < CATCH_UP_TAC_COUNT; ++tac) { //compare catch-up with as many single cycles
+        gbtimer_t ref_timer;
+        cpu_t ref_cpu;
+        zero_init_var(ref_timer);
+        zero_init_var(ref_cpu);
+        bus_t ref_bus;
+        zero_init_var(ref_bus);
+        data_t ref_regs[TIMER_SIZE] = {0};
+        for (size_t i = 0; i < TIMER_SIZE; ++i) {
+            ref_bus[TIMER_START + i] = &ref_regs[i];
+        }
+        ref_cpu.bus = &ref_bus;
+        ck_assert_err_none(timer_init(&ref_timer, &ref_cpu));
+
+        INIT;
+        ck_assert_err_none(timer_init(&timer, &cpu));
+        INIT_BUS;
+
+        *bus[REG_TAC] = *ref_bus[REG_TAC] = tac;
+        *bus[REG_TMA] = *ref_bus[REG_TMA] = (data_t) (rand() % 0x100);
+
+        for (size_t step = 0; step < CATCH_UP_STEP_COUNT; ++step) {
+            const uint64_t target = timer.cycles + (uint64_t) (rand() % CATCH_UP_STEP_MAX);
+            const uint64_t next = timer_next_event(&timer);
+
+            uint64_t overflow = UINT64_MAX;
+            while (ref_timer.cycles < target) {
+                timer_cycle(&ref_timer);
+                if (ref_cpu.IF != 0 && overflow == UINT64_MAX) overflow = ref_timer.cycles - 1;
+            }
+            ck_assert_err_none(timer_catch_up(&timer, target));
+
+            ck_assert_int_eq(timer.counter, ref_timer.counter);
+            ck_assert_int_eq(*bus[REG_DIV], *ref_bus[REG_DIV]);
+            ck_assert_int_eq(*bus[REG_TIMA], *ref_bus[REG_TIMA]);
+            ck_assert_int_eq(cpu.IF, ref_cpu.IF);
+            if (overflow != UINT64_MAX) {
+                ck_assert_int_eq(next, overflow);
+            } else {
+                ck_assert(next >= target);
+            }
+            cpu.IF = ref_cpu.IF = 0;
+        }
+    }
+#ifdef WITH_PRINT
+    printf("=== END of %s\n", __func__);
+#endif
+
+}
+END_TEST
+
 START_TEST(timer_listener_err)
 {
 // ------------------------------------------------------------
@@ -193,6 +269,8 @@ Suite* timer_test_suite()
 
     tcase_add_test(tc1, timer_cycle_err);
     tcase_add_test(tc1, timer_cycle_exec);
+    tcase_add_test(tc1, timer_catch_up_err);
+    tcase_add_test(tc1, timer_catch_up_exec);
     tcase_add_test(tc1, timer_listener_err);
     tcase_add_test(tc1, timer_listener_exec);
 